@@ -0,0 +1,193 @@
+// auditdec: decode the audit log stream the kernel exports over
+// its virtio console (see kernel/filelog_history.c) back into
+// records, one line each, and check the hash chain the frames
+// carry (see user/verifylog.c). Without the key, frames sealed
+// after set_log_key() are checked for linkage only. The stream may
+// hold several boots, one after the other.
+//
+// usage: auditdec [-k key] [stream]   (reads standard input by default)
+//        key is 32 hex digits, as given to verifylog -s
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#undef FILENAME_MAX  // host stdio's; filelog.h has xv6's
+#include "kernel/types.h"
+#include "kernel/filelog.h"
+#include "kernel/siphash.h"
+
+#define MAXRECORDS (4096 / sizeof(struct file_access_log))
+
+static struct file_access_log records[MAXRECORDS];
+
+// FNV-1a hash of n bytes, as computed by the kernel
+static uint
+export_sum(unsigned char *p, size_t n)
+{
+  uint h = 2166136261u;
+  for(size_t i = 0; i < n; i++)
+    h = (h ^ p[i]) * 16777619u;
+  return h;
+}
+
+// Check frame hdr, whose records are in records[], against the
+// chain. prev is the mac of the frame with index next - 1, if
+// chained is set. Returns 0 if the frame is bad.
+static int
+check_chain(struct export_frame *hdr, uint64 *key, int havekey,
+            int chained, uint next, uint64 prev)
+{
+  struct chunk_link *l = &hdr->link;
+  uint64 zero[2] = { 0, 0 };
+  uint64 *k = hdr->keyed ? key : zero;
+  int ok = 1;
+
+  if(chained && l->index != next)
+    fprintf(stderr, "auditdec: chunks %u to %u missing\n", next, l->index - 1);
+  if(l->count != hdr->count){
+    fprintf(stderr, "auditdec: chunk %u: count altered\n", l->index);
+    ok = 0;
+  }
+  if(!hdr->keyed || havekey){
+    if(siphash(k[0], k[1], records, hdr->count * sizeof(records[0])) != l->body){
+      fprintf(stderr, "auditdec: chunk %u: records altered\n", l->index);
+      ok = 0;
+    } else if(siphash(k[0], k[1], l, sizeof(*l)) != hdr->mac){
+      fprintf(stderr, "auditdec: chunk %u: seal altered\n", l->index);
+      ok = 0;
+    }
+  }
+  // the previous chunk is known only if we just saw it
+  if((l->index == 0 && l->prev != 0) ||
+     (chained && l->index == next && l->prev != prev)){
+    fprintf(stderr, "auditdec: chunk %u: chain broken\n", l->index);
+    ok = 0;
+  }
+  return ok;
+}
+
+static void
+print_record(struct file_access_log *r)
+{
+  char when[32];
+  time_t t = r->time;
+
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S UTC", gmtime(&t));
+  printf("%u %s pid %d ppid %d sid %d %.16s %.16s %.64s bytes %d ",
+         r->seq, when, r->pid, r->ppid, r->sid, r->proc_name,
+         r->operation, r->filename, r->bytes_transferred);
+  if(r->offset < 0)
+    printf("offset - ");
+  else
+    printf("offset %d ", r->offset);
+  printf("%s", r->status ? "OK" : "FAIL");
+  if(r->repeat > 1){
+    t = r->last_time;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S UTC", gmtime(&t));
+    printf(" repeat %u last %s", r->repeat, when);
+  }
+  if(r->watch)
+    printf(" watch %d", r->watch);
+  if(r->audit)
+    printf(" audit %d", r->audit);
+  if(r->inum)
+    printf(" inode %u image %016llx argv %016llx", r->inum,
+           (unsigned long long)r->hash, (unsigned long long)r->argv_hash);
+  printf("\n");
+}
+
+// Read the next frame header, resynchronizing on the magic one
+// byte at a time after garbage or a torn frame. Returns 0 at EOF.
+static int
+read_header(FILE *in, struct export_frame *hdr, long *skipped)
+{
+  if(fread(hdr, sizeof(*hdr), 1, in) != 1)
+    return 0;
+  while(hdr->magic != EXPORT_MAGIC || hdr->count == 0 || hdr->count > MAXRECORDS){
+    int c = fgetc(in);
+    if(c == EOF)
+      return 0;
+    memmove(hdr, (char*)hdr + 1, sizeof(*hdr) - 1);
+    ((char*)hdr)[sizeof(*hdr) - 1] = c;
+    (*skipped)++;
+  }
+  return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  FILE *in = stdin;
+  struct export_frame hdr;
+  uint next = 0, dropped = 0, nextchunk = 0;
+  uint64 key[2], prev = 0;
+  long skipped = 0;
+  int first = 1, havekey = 0, bad = 0;
+
+  if(argc >= 3 && strcmp(argv[1], "-k") == 0){
+    if(!parsekey(argv[2], key)){
+      fprintf(stderr, "auditdec: key must be 32 hex digits\n");
+      exit(1);
+    }
+    havekey = 1;
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc > 2){
+    fprintf(stderr, "usage: auditdec [-k key] [stream]\n");
+    exit(1);
+  }
+  if(argc == 2 && (in = fopen(argv[1], "rb")) == 0){
+    perror(argv[1]);
+    exit(1);
+  }
+
+  while(read_header(in, &hdr, &skipped)){
+    if(skipped){
+      fprintf(stderr, "auditdec: skipped %ld bytes of garbage\n", skipped);
+      skipped = 0;
+    }
+
+    size_t len = hdr.count * sizeof(struct file_access_log);
+    if(fread(records, len, 1, in) != 1){
+      fprintf(stderr, "auditdec: truncated frame of %u records\n", hdr.count);
+      break;
+    }
+    if(export_sum((unsigned char*)records, len) != hdr.sum){
+      fprintf(stderr, "auditdec: checksum mismatch, frame of %u records "
+              "from seq %u discarded\n", hdr.count, records[0].seq);
+      continue;
+    }
+
+    // the stream is appended to across boots: a chunk index going
+    // back, to 0 unless the first frames were dropped, starts the
+    // chain and the record numbers of a new boot
+    if(!first && hdr.link.index < nextchunk){
+      fprintf(stderr, "auditdec: new boot from chunk %u\n", hdr.link.index);
+      first = 1;
+      dropped = 0;
+    }
+
+    if(hdr.dropped != dropped){
+      fprintf(stderr, "auditdec: kernel dropped %u frames\n", hdr.dropped - dropped);
+      dropped = hdr.dropped;
+    }
+    if(!check_chain(&hdr, key, havekey, !first, nextchunk, prev))
+      bad++;
+    if(!first && records[0].seq != next)
+      fprintf(stderr, "auditdec: records %u to %u missing\n", next, records[0].seq - 1);
+    first = 0;
+
+    for(uint i = 0; i < hdr.count; i++)
+      print_record(&records[i]);
+    next = records[hdr.count - 1].seq + 1;
+    nextchunk = hdr.link.index + 1;
+    prev = hdr.mac;
+  }
+
+  if(in != stdin)
+    fclose(in);
+  exit(bad ? 1 : 0);
+}
@@ -1,9 +1,11 @@
 #include "filelog.h"
+#include "detect.h"
 
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct iwatch;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -48,21 +50,72 @@ int             filewrite(struct file*, uint64, int n);
 
 // filelog.c
 void            filelog_init(void);
-void            log_file_access(int pid, char *proc_name, char *operation, char *filename, int bytes, int success);
+int             log_file_access(int pid, char *proc_name, char *operation, char *filename, int bytes, int success, int audit, int off);
 int             get_file_logs(uint64 user_buf, int max_entries);
 int             get_file_stats(char *filename, uint64 user_stats);
 void            clear_file_logs(void);
+void            log_exec(char *path, int status);
+int             clear_history_logs(void);
+void            snap_tally(struct snap_counters *c, struct snap_file *files, int *nfiles, struct file_access_log *log);
+int             snapshot(uint64 user_secs, int n);
+void            filelog_drained(void);
+int             set_log_policy(int class, int policy);
+int             get_log_policy(uint64 user_stats);
 
 // suspicious_detect.c
 void            detector_init(void);
-void            check_suspicious(int pid, char *proc_name, char *operation, char *filename, int status);
+void            check_suspicious(int pid, char *proc_name, int op, char *filename, int status, int bytes, int watch);
+void            check_sequential(int pid, char *proc_name, char *filename, uint inum, uint off, uint n, uint size);
+int             set_detect_rules(uint64 user_rules, int n);
+int             get_detect_rules(uint64 user_rules, int max);
+int             set_baselines(uint64 user_baselines, int n);
+int             get_baselines(uint64 user_baselines, int max);
+int             get_file_cardinality(int pid, uint64 user_card);
+int             get_session_stats(int sid, uint64 user_stats);
+void            file_throttle(void);
+
+// detect_alert.c
+void            alert_init(void);
+void            alert_push(struct detect_alert *a);
+void            canary_alert(int op, char *path, uint inum);
+int             wait_alerts(uint64 user_buf, int max);
+void            get_alert_stats(struct alert_stats *st);
+int             set_alert_console(int mode);
+
+// watchlist.c
+void            watchlist_init(void);
+int             watchlist_lookup(char *path);
+int             set_watchlist(uint64 user_entries, int n);
+int             get_watchlist(uint64 user_entries, int max);
+
+// fim.c
+void            fim_init(void);
+void            fim_dirty(struct inode*, uint);
+void            fim_truncated(struct inode*);
+void            fim_forget(struct inode*);
+int             fim(struct inode*, int, uint64*);
+
+// iwatch.c
+void            iwatch_init(void);
+struct iwatch*  iwatch_alloc(struct inode*, int);
+void            iwatch_close(struct iwatch*);
+int             iwatch_read(struct iwatch*, uint64, int);
+void            iwatch_event(struct inode*, int);
 
 // filelog_history.c
 void            history_log_init(void);
 int             transfer_to_history(struct file_access_log *buffer, int count);
 int             get_history_logs(uint64 user_buf, int max_entries, int offset);
+int             history_read(int user_dst, uint64 dst, int max, uint *cursor);
+void            history_snapshot(struct snap_history *h);
+void            history_tally(uint last, struct snap_counters *c, struct snap_file *files, int *nfiles);
 void            get_history_stats(int *total_logs, int *total_chunks);
-void            clear_history_logs(void);
+int             history_clear(struct file_access_log *tomb, struct file_access_log *stalled,
+                              struct file_access_log *buf, int nbuf);
+int             set_log_key(uint64 k0, uint64 k1);
+int             get_history_chunk(uint index, uint64 user_meta, uint64 user_logs);
+void            history_set_policy(int policy);
+void            history_policy_stats(struct log_class_stats *st);
 
 // fs.c
 void            fsinit(int);
@@ -115,6 +168,8 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             parentpid(struct proc*);
+int             setsid(void);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
@@ -162,6 +217,10 @@ char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
+uint64          hash64(uint64, const void*, uint);
+
+// siphash.c
+uint64          siphash(uint64, uint64, const void*, uint);
 
 // syscall.c
 void            argint(int, int*);
@@ -170,6 +229,7 @@ void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+uint64          syscall_audit(uint64 enable, uint64 disable);
 
 // trap.c
 extern uint     ticks;
@@ -178,6 +238,9 @@ void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
 
+// rtc.c
+uint64          rtc_read(void);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
@@ -215,5 +278,10 @@ void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
 
+// virtio_console.c
+void            virtio_console_init(void);
+int             virtio_console_send(void *page, int len);
+void            virtio_console_intr(void);
+
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
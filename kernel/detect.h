@@ -0,0 +1,169 @@
+#ifndef DETECT_H
+#define DETECT_H
+
+#include "filelog.h"
+
+// Detection rules, shared between the kernel and detectctl.
+
+#define MAX_RULES        16
+#define RULE_PREFIX_MAX  32
+
+// Status a rule matches
+#define RULE_ST_ANY   0
+#define RULE_ST_FAIL  1
+#define RULE_ST_OK    2
+
+// What a rule's rate counts
+#define RULE_M_RATE   0  // matching events per second
+#define RULE_M_FILES  1  // distinct files touched in the recent window
+
+// Whose events a rule counts
+#define RULE_SCOPE_PROC     0  // each process on its own
+#define RULE_SCOPE_SESSION  1  // all processes of a session together
+
+// What to do when a rule matches
+#define RULE_ACT_ALERT   1  // alert once the rate threshold is reached
+#define RULE_ACT_IGNORE  2  // matching events never raise alerts
+#define RULE_ACT_THROTTLE 3 // alert, then rate-limit the process's file syscalls
+
+struct detect_rule {
+    uint opmask;                  // (1 << OP_x) per operation, 0 = any
+    int status;                   // RULE_ST_*
+    int rate;                     // threshold, per process, in units of metric
+    int action;                   // RULE_ACT_*
+    char proc_name[16];           // exact process name, "" = any
+    char prefix[RULE_PREFIX_MAX]; // leading path components, "" = any
+    int metric;                   // RULE_M_*
+    int scope;                    // RULE_SCOPE_*
+};
+
+// Watchlist of protected directories
+#define MAX_WATCHLIST   16
+#define WATCHLIST_PATH  64
+
+#define WL_LOG    1  // log every access, bypassing the log filters
+#define WL_ALERT  2  // alert on every access
+
+struct watchlist_entry {
+    char path[WATCHLIST_PATH];  // directory or file, matched as a prefix
+    int flags;                  // WL_*
+};
+
+// Learned per-program baselines
+#define MAX_BASELINES  16
+
+#define BL_OPS       0  // operations per second
+#define BL_FAIL      1  // fraction of operations that failed
+#define BL_FILES     2  // distinct files per second
+#define BL_BYTES     3  // bytes read or written per second
+#define BL_NMETRICS  4
+
+#define BL_FRAC  8  // fraction bits of mean[] and dev[]
+
+struct prog_baseline {
+    char proc_name[16];
+    uint samples;             // active seconds learned
+    uint mean[BL_NMETRICS];   // EWMA of each metric
+    uint dev[BL_NMETRICS];    // EWMA of its absolute deviation from mean
+};
+
+// Distinct files a process touched, estimated with a HyperLogLog
+// sketch per window of HLL_WINDOW seconds
+#define HLL_WINDOW  30
+
+struct file_cardinality {
+    uint current;   // distinct files in the current window
+    uint previous;  // distinct files in the previous window
+    uint recent;    // both windows together, the last 30 to 60 seconds
+    uint window;    // window length in seconds
+};
+
+// Activity of a session, a process tree rooted at a setsid() caller
+struct session_stats {
+    int sid;
+    int procs;      // live processes in the session
+    uint events;    // file events since the session was first seen
+    uint failures;  // events that failed
+    uint rate;      // events in the last second
+    uint distinct;  // distinct files in the last 30 to 60 seconds
+};
+
+// File integrity monitoring of IA_FIM files, see kernel/fim.c
+#define MAX_FIM  16  // files with a hash tree at once
+
+// fim() operations
+#define FIM_ROOT      0  // current root hash
+#define FIM_BASELINE  1  // make the current root the baseline
+#define FIM_LOAD      2  // make *root the baseline
+#define FIM_CHECK     3  // current root; 0 if it matches the baseline, 1 if not
+
+// Inode watches, see kernel/iwatch.c
+#define MAX_IWATCH    16  // watch descriptors open at once
+#define IWATCH_QUEUE  16  // events queued per watch before dropping
+
+// Events a watch() mask selects
+#define IW_OPEN      0x1
+#define IW_WRITE     0x2
+#define IW_DELETE    0x4
+#define IW_ALL       (IW_OPEN | IW_WRITE | IW_DELETE)
+#define IW_OVERFLOW  0x8  // not selectable: count events were dropped
+
+// One event, as read from a watch descriptor
+struct iwatch_event {
+    int mask;              // one IW_* bit
+    uint inum;
+    int pid;               // process that caused it
+    uint tick;
+    uint count;            // for IW_OVERFLOW, events dropped
+    char proc_name[16];
+};
+
+// Alert kinds
+#define ALERT_RULE            1  // a rule's rate threshold was reached
+#define ALERT_RANSOM_REWRITE  2  // many files read then overwritten
+#define ALERT_RANSOM_REPLACE  3  // many files replaced by a sibling and deleted
+#define ALERT_WATCHLIST       4  // access under a WL_ALERT watchlist entry
+#define ALERT_CANARY          5  // a canary (IA_CANARY) file was touched
+#define ALERT_SEQ_READ        6  // a watched file was read start to end
+#define ALERT_ANOMALY         7  // a second of activity far above the baseline
+#define ALERT_DISTINCT        8  // a rule's distinct-file threshold was reached
+#define ALERT_THROTTLE        9  // a process's file syscalls are now throttled
+#define NALERTKINDS          10  // one more than the highest ALERT_*
+
+// Console fallback modes for alerts
+#define ALERT_CONSOLE_OFF       0  // alerts only go to the queue
+#define ALERT_CONSOLE_OVERFLOW  1  // print alerts the queue had to drop
+#define ALERT_CONSOLE_ALL       2  // print every alert as well
+
+// One alert, as returned by wait_alerts()
+struct detect_alert {
+    uint seq;                     // alert sequence number
+    uint tick;                    // when it was raised
+    int kind;                     // ALERT_*
+    int pid;
+    int ppid;                     // parent pid, 0 if none
+    int sid;                      // session id
+    uint inum;                    // inode number, 0 if unknown
+    int rule;                     // rule index or -1; BL_* for ALERT_ANOMALY
+    int rate;                     // events per second, distinct files for
+                                  // ALERT_DISTINCT, file size for
+                                  // ALERT_SEQ_READ, score for ALERT_ANOMALY
+    int op;                       // OP_* of the triggering event, -1 for
+                                  // firings flushed once their backoff ran out
+    int status;                   // 1 OK, 0 FAIL
+    uint count;                   // times it fired since the last alert
+    uint span;                    // ticks those firings were spread over
+    char proc_name[16];
+    char filename[FILENAME_MAX];
+};
+
+struct alert_stats {
+    uint raised;     // alerts raised since boot
+    uint delivered;  // alerts returned by wait_alerts()
+    uint dropped;    // alerts lost because the queue was full
+    uint canaries;   // canary alerts raised
+    int queued;      // alerts waiting to be read
+    int console;     // ALERT_CONSOLE_* mode
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define ALERT_QUEUE_SIZE 32
+
+// Bounded queue of alerts waiting for a wait_alerts() reader.
+// Raising an alert is a copy into the ring; nothing touches the
+// console or the UART on the syscall path unless asked to.
+struct {
+    struct spinlock lock;
+    struct detect_alert q[ALERT_QUEUE_SIZE];
+    uint head;      // next alert to read
+    uint tail;      // next free slot
+    int waiters;    // processes sleeping in wait_alerts()
+    int console;    // ALERT_CONSOLE_* mode
+    uint raised;
+    uint delivered;
+    uint dropped;
+    uint canaries;
+} alert_queue;
+
+void
+alert_init(void)
+{
+    initlock(&alert_queue.lock, "alerts");
+    alert_queue.head = 0;
+    alert_queue.tail = 0;
+    alert_queue.waiters = 0;
+    alert_queue.console = ALERT_CONSOLE_OFF;
+    alert_queue.raised = 0;
+    alert_queue.delivered = 0;
+    alert_queue.dropped = 0;
+    alert_queue.canaries = 0;
+}
+
+static void
+alert_print(struct detect_alert *a)
+{
+    if(a->op < 0) {
+        printf("ALERT: PID %d (%s) alert kind %d rule %d fired %d more times in %d ticks\n",
+               a->pid, a->proc_name, a->kind, a->rule, a->count, a->span);
+        return;
+    }
+    if(a->kind == ALERT_RANSOM_REWRITE) {
+        printf("ALERT: PID %d (%s) rewrote %d files/sec in place, last %s\n",
+               a->pid, a->proc_name, a->rate, a->filename);
+    } else if(a->kind == ALERT_RANSOM_REPLACE) {
+        printf("ALERT: PID %d (%s) replaced %d files/sec, last deleted %s\n",
+               a->pid, a->proc_name, a->rate, a->filename);
+    } else if(a->kind == ALERT_THROTTLE) {
+        printf("ALERT: PID %d (%s) file syscalls throttled by rule %d\n",
+               a->pid, a->proc_name, a->rule);
+    } else if(a->kind == ALERT_DISTINCT) {
+        printf("ALERT: PID %d (%s) touched ~%d distinct files (rule %d)\n",
+               a->pid, a->proc_name, a->rate, a->rule);
+    } else if(a->kind == ALERT_ANOMALY) {
+        printf("ALERT: PID %d (%s) is %d deviations above its baseline (metric %d)\n",
+               a->pid, a->proc_name, a->rate, a->rule);
+    } else if(a->kind == ALERT_SEQ_READ) {
+        printf("ALERT: PID %d (%s) read all %d bytes of %s sequentially\n",
+               a->pid, a->proc_name, a->rate, a->filename);
+    } else if(a->kind == ALERT_CANARY) {
+        printf("ALERT: PID %d (%s, parent %d) touched canary %s (inode %d)\n",
+               a->pid, a->proc_name, a->ppid, a->filename, a->inum);
+    } else if(a->kind == ALERT_WATCHLIST) {
+        printf("ALERT: PID %d (%s) accessed protected path %s\n",
+               a->pid, a->proc_name, a->filename);
+    } else {
+        printf("ALERT: PID %d (%s) rule %d: %d %s events/sec on %s\n",
+               a->pid, a->proc_name, a->rule, a->rate,
+               a->status ? "OK" : "FAIL", a->filename);
+    }
+    if(a->count > 1) {
+        printf("ALERT: (fired %d times in the last %d ticks)\n", a->count, a->span);
+    }
+}
+
+// Queue an alert, dropping it if the queue is full
+void
+alert_push(struct detect_alert *a)
+{
+    int print = 0;
+
+    acquire(&alert_queue.lock);
+    a->seq = alert_queue.raised++;
+    if(alert_queue.tail - alert_queue.head == ALERT_QUEUE_SIZE) {
+        alert_queue.dropped++;
+        print = alert_queue.console != ALERT_CONSOLE_OFF;
+    } else {
+        alert_queue.q[alert_queue.tail++ % ALERT_QUEUE_SIZE] = *a;
+        print = alert_queue.console == ALERT_CONSOLE_ALL;
+        if(alert_queue.waiters) {
+            wakeup(&alert_queue.head);
+        }
+    }
+    release(&alert_queue.lock);
+
+    if(print) {
+        alert_print(a);
+    }
+}
+
+// Make room in the full queue for a canary alert by dropping its
+// oldest other alert, keeping the rest in order. Only a queue full
+// of canary alerts loses its oldest canary alert.
+// Caller holds alert_queue.lock.
+static void
+alert_evict(void)
+{
+    uint i = alert_queue.head;
+
+    while(i != alert_queue.tail &&
+          alert_queue.q[i % ALERT_QUEUE_SIZE].kind == ALERT_CANARY) {
+        i++;
+    }
+    if(i == alert_queue.tail) {
+        i = alert_queue.head;
+    }
+    for(; i != alert_queue.head; i--) {
+        alert_queue.q[i % ALERT_QUEUE_SIZE] = alert_queue.q[(i - 1) % ALERT_QUEUE_SIZE];
+    }
+    alert_queue.head++;
+    alert_queue.dropped++;
+}
+
+// Fast path for canary files: no filters, no rate limiting, and the
+// alert is never dropped for another kind of alert. A full queue
+// loses its oldest other alert instead, see alert_evict().
+void
+canary_alert(int op, char *path, uint inum)
+{
+    struct proc *p = myproc();
+    struct detect_alert a;
+
+    a.tick = ticks;
+    a.kind = ALERT_CANARY;
+    a.pid = p->pid;
+    a.ppid = parentpid(p);
+    a.inum = inum;
+    a.rule = -1;
+    a.rate = 0;
+    a.op = op;
+    a.status = 1;
+    a.count = 1;
+    a.span = 0;
+    safestrcpy(a.proc_name, p->name, sizeof(a.proc_name));
+    safestrcpy(a.filename, path, sizeof(a.filename));
+
+    acquire(&alert_queue.lock);
+    a.seq = alert_queue.raised++;
+    alert_queue.canaries++;
+    if(alert_queue.tail - alert_queue.head == ALERT_QUEUE_SIZE) {
+        alert_evict();
+    }
+    alert_queue.q[alert_queue.tail++ % ALERT_QUEUE_SIZE] = a;
+    if(alert_queue.waiters) {
+        wakeup(&alert_queue.head);
+    }
+    int print = alert_queue.console != ALERT_CONSOLE_OFF;
+    release(&alert_queue.lock);
+
+    if(print) {
+        alert_print(&a);
+    }
+}
+
+// Block until at least one alert is queued, then copy up to max
+// alerts to user space. Returns the number copied.
+int
+wait_alerts(uint64 user_buf, int max)
+{
+    struct proc *p = myproc();
+    int count = 0;
+
+    if(max <= 0) {
+        return 0;
+    }
+
+    acquire(&alert_queue.lock);
+    while(alert_queue.head == alert_queue.tail) {
+        if(killed(p)) {
+            release(&alert_queue.lock);
+            return -1;
+        }
+        alert_queue.waiters++;
+        sleep(&alert_queue.head, &alert_queue.lock);
+        alert_queue.waiters--;
+    }
+
+    while(count < max && alert_queue.head != alert_queue.tail) {
+        struct detect_alert *a = &alert_queue.q[alert_queue.head % ALERT_QUEUE_SIZE];
+        if(copyout(p->pagetable, user_buf + count * sizeof(struct detect_alert),
+                   (char*)a, sizeof(struct detect_alert)) < 0) {
+            break;
+        }
+        alert_queue.head++;
+        alert_queue.delivered++;
+        count++;
+    }
+    release(&alert_queue.lock);
+
+    return count > 0 ? count : -1;
+}
+
+void
+get_alert_stats(struct alert_stats *st)
+{
+    acquire(&alert_queue.lock);
+    st->raised = alert_queue.raised;
+    st->delivered = alert_queue.delivered;
+    st->dropped = alert_queue.dropped;
+    st->canaries = alert_queue.canaries;
+    st->queued = alert_queue.tail - alert_queue.head;
+    st->console = alert_queue.console;
+    release(&alert_queue.lock);
+}
+
+// Set the console fallback mode, returns the previous one
+int
+set_alert_console(int mode)
+{
+    if(mode < ALERT_CONSOLE_OFF || mode > ALERT_CONSOLE_ALL) {
+        return -1;
+    }
+
+    acquire(&alert_queue.lock);
+    int old = alert_queue.console;
+    alert_queue.console = mode;
+    release(&alert_queue.lock);
+    return old;
+}
@@ -6,8 +6,11 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+static int loadseg(pde_t *, uint64, struct inode *, uint, uint, uint64 *);
 
 int flags2perm(int flags)
 {
@@ -30,6 +33,17 @@ exec(char *path, char **argv)
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
+  uint64 texthash, *hp;
+
+  // Record what is run for the audit log: the argv digest, and
+  // below the binary's inode and a hash of its ELF header and
+  // loadable segments, computed while they are read in and cached
+  // in the inode until the file is written.
+  p->exec_argv = 0;
+  for(i = 0; argv[i] && i < MAXARG; i++)
+    p->exec_argv = hash64(p->exec_argv, argv[i], strlen(argv[i]) + 1);
+  p->exec_inum = 0;
+  p->exec_hash = 0;
 
   begin_op();
 
@@ -38,6 +52,7 @@ exec(char *path, char **argv)
     return -1;
   }
   ilock(ip);
+  p->exec_inum = ip->inum;
 
   // Check ELF header
   if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -46,6 +61,12 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
+  hp = 0;
+  if(!ip->texthashed){
+    texthash = hash64(0, &elf, sizeof(elf));
+    hp = &texthash;
+  }
+
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
@@ -65,9 +86,14 @@ exec(char *path, char **argv)
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
       goto bad;
     sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz, hp) < 0)
       goto bad;
   }
+  if(hp){
+    ip->texthash = texthash;
+    ip->texthashed = 1;
+  }
+  p->exec_hash = ip->texthash;
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -143,9 +169,10 @@ exec(char *path, char **argv)
 // Load a program segment into pagetable at virtual address va.
 // va must be page-aligned
 // and the pages from va to va+sz must already be mapped.
+// If hp is not 0, fold the segment into the hash *hp.
 // Returns 0 on success, -1 on failure.
 static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz, uint64 *hp)
 {
   uint i, n;
   uint64 pa;
@@ -160,6 +187,8 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
       n = PGSIZE;
     if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
       return -1;
+    if(hp)
+      *hp = hash64(*hp, (void*)pa, n);
   }
   
   return 0;
@@ -1,13 +1,14 @@
 #include "param.h"
 
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_WATCH } type;
   int ref; // reference count
   char readable;
   char writable;
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
-  uint off;          // FD_INODE
+  struct iwatch *watch; // FD_WATCH
+  uint off;          // FD_INODE, and FD_DEVICE read cursor
   short major;       // FD_DEVICE
   char path[MAXPATH];
 };
@@ -24,7 +25,13 @@ struct inode {
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
+  uint64 texthash;    // exec hash of the ELF header and segments,
+  int texthashed;     // valid until the file is written
+  struct iwatch *watches; // watch() descriptors, 0 if unwatched;
+                          // protected by the iwatch lock
+
   short type;         // copy of disk inode
+  uchar audit;
   short major;
   short minor;
   short nlink;
@@ -34,10 +41,11 @@ struct inode {
 
 // map major device number to device functions.
 struct devsw {
-  int (*read)(int, uint64, int);
-  int (*write)(int, uint64, int);
+  int (*read)(struct file*, int, uint64, int);
+  int (*write)(struct file*, int, uint64, int);
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define AUDITLOG 2
@@ -3,6 +3,9 @@
 #include "param.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
 #include "defs.h"
 #include "filelog.h"
 #include "timeutil.h"
@@ -12,9 +15,25 @@ struct {
     struct spinlock lock;
     struct file_access_log entries[MAX_LOG_ENTRIES];
     int next_index;
-    int total_accesses;
+    int total_accesses;  // events, folded repeats included
+    int folded;          // events folded into the record before
+    uint seq;       // sequence number of the next entry
+    int pending;    // full buffers handed off but not yet in history
+    int readers;    // auditlog readers waiting for new entries
+    uint read_seq;  // entries below it may have been streamed
+    struct file_access_log *stalled;  // a full buffer not yet in history
+    int draining;      // stalled is on its way to history right now
+    int policy;        // LOG_* while stalled
+    uint overwritten;  // records lost to history refusing them
+    uint dropped;      // records refused while stalled
+    uint blocked;      // times a producer waited while stalled
+    struct file_access_log reserve[MAX_LOG_ENTRIES];  // stalled, if out of memory
 } access_log_buffer;
 
+static int auditlog_read(struct file *f, int user_dst, uint64 dst, int n);
+static int log_record(int pid, char *proc_name, char *operation, char *filename,
+                      int bytes, int status, int audit, int off, struct proc *exec);
+
 // Initialize the file access logging system
 void
 filelog_init(void)
@@ -26,7 +45,18 @@ filelog_init(void)
     for(int i=0; i<MAX_LOG_ENTRIES; i++){
         access_log_buffer.entries[i].valid = 0;
     }
+    devsw[AUDITLOG].read = auditlog_read;
     detector_init();
+    watchlist_init();
+    fim_init();
+}
+
+// verifylog is what marks history chunks drained when there is no
+// host to export them to: it must never wait for history to drain
+static int
+is_drainer(char *proc_name)
+{
+    return strncmp(proc_name, "verifylog", 16) == 0;
 }
 
 // Helper function to determine if we should log this process
@@ -38,6 +68,7 @@ should_log_process(char *proc_name)
     if(strncmp(proc_name, "showhistory", 8) == 0) return 0;
     if(strncmp(proc_name, "init", 4) == 0) return 0;
     if(strncmp(proc_name, "ls", 2) == 0) return 0;
+    if(is_drainer(proc_name)) return 0;
     return 1; // log all other processes, including sh, echo, ls, etc.
 }
 
@@ -66,13 +97,124 @@ should_log_operation(char *proc_name, char *operation, int bytes, int file_type)
     return 1; // other operations by default
 }
 
-// Main logging function with built-in filtering
+// Map an operation name to its OP_ code, 0 if unknown
+static int
+op_code(char *operation)
+{
+    static char *names[NOPS] = {
+        [OP_OPEN] "OPEN", [OP_READ] "READ", [OP_WRITE] "WRITE",
+        [OP_CLOSE] "CLOSE", [OP_CREATE] "CREATE", [OP_DELETE] "DELETE",
+        [OP_CHDIR] "CHDIR", [OP_EXEC] "EXEC", [OP_LINK] "LINK",
+        [OP_MKDIR] "MKDIR", [OP_MKNOD] "MKNOD", [OP_DUP] "DUP",
+        [OP_PIPE] "PIPE", [OP_FORK] "FORK",
+    };
+
+    for(int op = 1; op < NOPS; op++) {
+        if(strncmp(operation, names[op], OPERATION_MAX) == 0) {
+            return op;
+        }
+    }
+    return 0;
+}
+
+// Main logging function with built-in filtering.
+// off is the file offset of a READ/WRITE, -1 for other operations.
+// Returns the watchlist flags of filename.
+int
+log_file_access(int pid, char *proc_name, char *operation, char *filename, int bytes, int status, int audit, int off)
+{
+    return log_record(pid, proc_name, operation, filename, bytes, status, audit, off, 0);
+}
+
+// Log an exec of path by the current process, with the identity
+// exec() recorded in it. Called by the syscall audit hook.
+void
+log_exec(char *path, int status)
+{
+    struct proc *p = myproc();
+    log_record(p->pid, p->name, "EXEC", path, 0, status, 0, -1, p);
+}
+
+// Free the stalled buffer once it is in history or given up.
+// Caller holds access_log_buffer.lock.
+static void
+unstall(void)
+{
+    if(access_log_buffer.stalled != access_log_buffer.reserve) {
+        kfree(access_log_buffer.stalled);
+    }
+    access_log_buffer.stalled = 0;
+}
+
+// History has room again: wake producers waiting to get a stalled
+// buffer into it. Called without the history lock held.
 void
-log_file_access(int pid, char *proc_name, char *operation, char *filename, int bytes, int status)
+filelog_drained(void)
+{
+    acquire(&access_log_buffer.lock);
+    if(access_log_buffer.stalled) {
+        wakeup(&access_log_buffer.stalled);
+    }
+    release(&access_log_buffer.lock);
+}
+
+// Set the overflow policy, LOG_*, of retention class class.
+int
+set_log_policy(int class, int policy)
 {
+    if(policy < LOG_OVERWRITE || policy > LOG_BLOCK) {
+        return -1;
+    }
+    acquire(&access_log_buffer.lock);
+    if(class == LOG_BUFFER) {
+        access_log_buffer.policy = policy;
+    } else if(class == LOG_HISTORY) {
+        history_set_policy(policy);
+    } else {
+        release(&access_log_buffer.lock);
+        return -1;
+    }
+    // waiting producers retry under the new policy
+    if(access_log_buffer.stalled) {
+        wakeup(&access_log_buffer.stalled);
+    }
+    release(&access_log_buffer.lock);
+    return 0;
+}
+
+// Copy out the policy and counters of each retention class,
+// struct log_class_stats[NLOGCLASS].
+int
+get_log_policy(uint64 user_stats)
+{
+    struct log_class_stats st[NLOGCLASS];
+
+    acquire(&access_log_buffer.lock);
+    st[LOG_BUFFER].policy = access_log_buffer.policy;
+    st[LOG_BUFFER].overwritten = access_log_buffer.overwritten;
+    st[LOG_BUFFER].dropped = access_log_buffer.dropped;
+    st[LOG_BUFFER].blocked = access_log_buffer.blocked;
+    history_policy_stats(&st[LOG_HISTORY]);
+    release(&access_log_buffer.lock);
+
+    if(copyout(myproc()->pagetable, user_stats, (char*)st, sizeof(st)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// log_file_access(), and for an EXEC the identity exec() recorded in p
+static int
+log_record(int pid, char *proc_name, char *operation, char *filename, int bytes, int status, int audit, int off, struct proc *exec)
+{
+    // Accesses under a protected directory or to an audited
+    // inode skip the filters
+    int watch = watchlist_lookup(filename);
+    int forced = (watch & WL_LOG) || (audit & IA_AUDIT);
+
     // First filter: check if we should log this process
-    if(!should_log_process(proc_name)) {
-        return;
+    if(!forced && !should_log_process(proc_name)) {
+        return watch;
     }
 
     // Determine file type: 1 for real files, 0 for devices/stdout
@@ -82,45 +224,172 @@ log_file_access(int pid, char *proc_name, char *operation, char *filename, int b
     if(strncmp(filename, "stdout", 6) == 0) file_type = 0;
 
     // Second filter: check if we should log this operation
-    if(!should_log_operation(proc_name, operation, bytes, file_type)) {
-        return;
+    int log_it = forced || should_log_operation(proc_name, operation, bytes, file_type);
+
+    // detect suspicious activity; the detector sees every file event,
+    // even the small reads the log filters out
+    if(log_it || file_type == 1) {
+        check_suspicious(pid, proc_name, op_code(operation), filename, status, bytes, watch);
     }
 
-    // detect suspicious activity
-    check_suspicious(pid, proc_name, operation, filename, status);
+    if(!log_it) {
+        return watch;
+    }
 
     // Passed all filters, now log it
+    int ppid = parentpid(myproc());
     acquire(&access_log_buffer.lock);
+
+    // A full buffer not yet in history, on its way or refused, has
+    // to be in before the ring fills again. Until then the buffer's
+    // policy decides what becomes of the record that would fill it.
+    // LOG_BLOCK waits here, where no caller holds a lock.
+    while(access_log_buffer.stalled) {
+        if(!access_log_buffer.draining &&
+           transfer_to_history(access_log_buffer.stalled, MAX_LOG_ENTRIES) == 0) {
+            unstall();
+            break;
+        }
+        if(access_log_buffer.next_index < MAX_LOG_ENTRIES - 1) {
+            break;  // the ring has room meanwhile
+        }
+        if(access_log_buffer.policy == LOG_OVERWRITE) {
+            // a buffer in flight is the draining producer's to count
+            if(!access_log_buffer.draining) {
+                access_log_buffer.overwritten += MAX_LOG_ENTRIES;
+                unstall();
+            }
+            break;
+        }
+        if(access_log_buffer.policy == LOG_DROP_NEW || killed(myproc()) ||
+           is_drainer(proc_name)) {
+            access_log_buffer.dropped++;
+            release(&access_log_buffer.lock);
+            return watch;
+        }
+        access_log_buffer.blocked++;
+        sleep(&access_log_buffer.stalled, &access_log_buffer.lock);
+    }
+
+    // A run of identical events, such as a loop retrying a failed
+    // open, is folded into the record of its first one, which keeps
+    // count. Only a record neither drained to history nor streamed
+    // to an auditlog reader can grow, so that every consumer sees
+    // its final count: the run starts a new record after either.
+    if(exec == 0 && access_log_buffer.next_index > 0) {
+        struct file_access_log *last = &access_log_buffer.entries[access_log_buffer.next_index - 1];
+        if(last->valid && last->seq >= access_log_buffer.read_seq &&
+           last->pid == pid && last->status == status &&
+           strncmp(last->operation, operation, OPERATION_MAX) == 0 &&
+           strncmp(last->filename, filename, FILENAME_MAX) == 0) {
+            last->repeat++;
+            last->last_time = current_time();
+            if(status && bytes > 0) {
+                last->bytes_transferred += bytes;
+            }
+            access_log_buffer.total_accesses++;
+            access_log_buffer.folded++;
+            release(&access_log_buffer.lock);
+            return watch;
+        }
+    }
+
     struct file_access_log *entry = &access_log_buffer.entries[access_log_buffer.next_index];
+    entry->seq = access_log_buffer.seq++;
     entry->pid = pid;
+    entry->ppid = ppid;
+    entry->sid = myproc()->sid;
     safestrcpy(entry->proc_name, proc_name, sizeof(entry->proc_name));
     safestrcpy(entry->filename, filename, sizeof(entry->filename));
     safestrcpy(entry->operation, operation, sizeof(entry->operation));
     entry->bytes_transferred = bytes;
-    format_timestamp(ticks, entry->timestamp, sizeof(entry->timestamp));
+    entry->offset = off;
+    entry->time = current_time();
     entry->status = status;
+    entry->watch = watch;
+    entry->audit = audit;
+    entry->inum = exec ? exec->exec_inum : 0;
+    entry->hash = exec ? exec->exec_hash : 0;
+    entry->argv_hash = exec ? exec->exec_argv : 0;
+    entry->repeat = 1;
+    entry->last_time = entry->time;
     entry->valid = 1;
 
     // Update index and check if buffer is full
     access_log_buffer.next_index = (access_log_buffer.next_index + 1) % MAX_LOG_ENTRIES;
     access_log_buffer.total_accesses++;
+    if(access_log_buffer.readers > 0) {
+        wakeup(&access_log_buffer.seq);
+    }
 
     // If we've wrapped around to 0, transfer to long-term storage
     if(access_log_buffer.next_index == 0) {
-        // Copy all current entries for transfer
-        struct file_access_log transfer_buffer[MAX_LOG_ENTRIES];
-        for(int i = 0; i < MAX_LOG_ENTRIES; i++) {
-            transfer_buffer[i] = access_log_buffer.entries[i];
+        // Copy all current entries for transfer. The copy goes in a
+        // scratch page: the whole buffer does not fit on the kernel stack.
+        struct file_access_log *transfer_buffer = (struct file_access_log*)kalloc();
+        if(transfer_buffer == 0) {
+            // out of memory: transfer straight from the buffer instead,
+            // stalling a copy in the reserve if history refuses it.
+            // Only under LOG_OVERWRITE can a buffer be stalled already.
+            if(transfer_to_history(access_log_buffer.entries, MAX_LOG_ENTRIES) < 0) {
+                if(access_log_buffer.policy == LOG_OVERWRITE || access_log_buffer.stalled) {
+                    access_log_buffer.overwritten += MAX_LOG_ENTRIES;
+                } else {
+                    memmove(access_log_buffer.reserve, access_log_buffer.entries,
+                            sizeof(access_log_buffer.entries));
+                    access_log_buffer.stalled = access_log_buffer.reserve;
+                }
+            }
+            release(&access_log_buffer.lock);
+            return watch;
+        }
+        memmove(transfer_buffer, access_log_buffer.entries, sizeof(access_log_buffer.entries));
+        access_log_buffer.pending++;
+
+        // Mark the copy stalled before letting go of the lock, so that
+        // producers filling the ring meanwhile wait for it, as the
+        // policy says, rather than wrap past it. Only under
+        // LOG_OVERWRITE can another copy still be in flight.
+        int mine = access_log_buffer.stalled == 0;
+        if(mine) {
+            access_log_buffer.stalled = transfer_buffer;
+            access_log_buffer.draining = 1;
         }
         
         release(&access_log_buffer.lock);
         
         // Transfer to history storage (outside lock to avoid blocking)
-        transfer_to_history(transfer_buffer, MAX_LOG_ENTRIES);
-        return;
+        int r = transfer_to_history(transfer_buffer, MAX_LOG_ENTRIES);
+
+        // auditlog readers hold off on the buffer while entries are
+        // in flight, so that none is skipped
+        acquire(&access_log_buffer.lock);
+        if(mine) {
+            access_log_buffer.draining = 0;
+            if(r == 0) {
+                unstall();
+            } else if(access_log_buffer.policy == LOG_OVERWRITE) {
+                access_log_buffer.overwritten += MAX_LOG_ENTRIES;
+                unstall();
+            }
+            // else it stays stalled, for the next producer to retry
+            wakeup(&access_log_buffer.stalled);
+        } else {
+            if(r != 0) {
+                access_log_buffer.overwritten += MAX_LOG_ENTRIES;
+            }
+            kfree(transfer_buffer);
+        }
+        access_log_buffer.pending--;
+        if(access_log_buffer.readers > 0) {
+            wakeup(&access_log_buffer.seq);
+        }
+        release(&access_log_buffer.lock);
+        return watch;
     }
     
     release(&access_log_buffer.lock);
+    return watch;
 }
 
 // Get recent file access logs
@@ -177,13 +446,13 @@ get_file_stats(char *filename, uint64 user_stats)
     
     for(int i = 0; i < MAX_LOG_ENTRIES; i++) {
         if(access_log_buffer.entries[i].valid && strncmp(access_log_buffer.entries[i].filename, filename, FILENAME_MAX) == 0) {
-            stats.total_accesses++;
+            stats.total_accesses += access_log_buffer.entries[i].repeat;
             
             if(strncmp(access_log_buffer.entries[i].operation, "READ", 4) == 0) {
-                stats.read_count++;
+                stats.read_count += access_log_buffer.entries[i].repeat;
                 stats.total_bytes_read += access_log_buffer.entries[i].bytes_transferred;
             } else if(strncmp(access_log_buffer.entries[i].operation, "WRITE", 5) == 0) {
-                stats.write_count++;
+                stats.write_count += access_log_buffer.entries[i].repeat;
                 stats.total_bytes_written += access_log_buffer.entries[i].bytes_transferred;
             }
         }
@@ -198,18 +467,374 @@ get_file_stats(char *filename, uint64 user_stats)
     return 0;
 }
 
-// Clear all logs (for administrative purposes)
+// Fill in a CLEAR record: the current process erased erased
+// records of what. Caller holds access_log_buffer.lock.
+static void
+tombstone(struct file_access_log *e, char *what, int erased, int ppid)
+{
+    struct proc *p = myproc();
+
+    memset(e, 0, sizeof(*e));
+    e->seq = access_log_buffer.seq++;
+    e->pid = p->pid;
+    e->ppid = ppid;
+    e->sid = p->sid;
+    safestrcpy(e->proc_name, p->name, sizeof(e->proc_name));
+    safestrcpy(e->filename, what, sizeof(e->filename));
+    safestrcpy(e->operation, "CLEAR", sizeof(e->operation));
+    e->bytes_transferred = erased;
+    e->offset = -1;
+    e->status = 1;
+    e->time = current_time();
+    e->repeat = 1;
+    e->last_time = e->time;
+    e->valid = 1;
+}
+
+// Clear all logs (for administrative purposes). A CLEAR record
+// saying how many not yet sealed records were lost takes their
+// place, to be sealed into the history like any other.
 void
 clear_file_logs(void)
 {
+    int ppid = parentpid(myproc());
+
     acquire(&access_log_buffer.lock);
 
+    // entries before next_index were logged since the last drain,
+    // and a stalled buffer never was drained; one in flight is left
+    // to the producer moving it
+    int erased = access_log_buffer.next_index;
+    if(access_log_buffer.stalled && !access_log_buffer.draining) {
+        erased += MAX_LOG_ENTRIES;
+        unstall();
+        wakeup(&access_log_buffer.stalled);
+    }
     for(int i = 0; i < MAX_LOG_ENTRIES; i++) {
         access_log_buffer.entries[i].valid = 0;
     }
+    tombstone(&access_log_buffer.entries[0], "log buffer", erased, ppid);
     
-    access_log_buffer.next_index = 0;
-    access_log_buffer.total_accesses = 0;
+    access_log_buffer.next_index = 1;
+    access_log_buffer.total_accesses = 1;
+    access_log_buffer.folded = 0;
+    if(access_log_buffer.readers > 0) {
+        wakeup(&access_log_buffer.seq);
+    }
     
     release(&access_log_buffer.lock);
-}
\ No newline at end of file
+}
+
+// Clear the history, leaving a sealed CLEAR record in its place.
+// The records not yet in history are sealed ahead of it, so that
+// history stays in seq order. Returns -1 if the history could not
+// be cleared.
+int
+clear_history_logs(void)
+{
+    struct file_access_log tomb;
+    int ppid = parentpid(myproc());
+    int r;
+
+    // wait out buffers in flight, which would land after the CLEAR
+    acquire(&access_log_buffer.lock);
+    while(access_log_buffer.pending > 0) {
+        access_log_buffer.readers++;
+        sleep(&access_log_buffer.seq, &access_log_buffer.lock);
+        access_log_buffer.readers--;
+    }
+    int n = access_log_buffer.next_index;
+    int wake = access_log_buffer.stalled != 0;
+    tombstone(&tomb, "history", 0, ppid);
+    r = history_clear(&tomb, access_log_buffer.stalled, access_log_buffer.entries, n);
+    if(r == 0) {
+        // the entries since the last drain are in history now
+        for(int i = 0; i < n; i++) {
+            access_log_buffer.entries[i].valid = 0;
+        }
+        access_log_buffer.next_index = 0;
+        if(access_log_buffer.stalled) {
+            unstall();
+        }
+    }
+    if(wake) {
+        wakeup(&access_log_buffer.stalled);
+    }
+    if(access_log_buffer.readers > 0) {
+        wakeup(&access_log_buffer.seq);
+    }
+    release(&access_log_buffer.lock);
+    return r;
+}
+
+// Count one retained record into the snapshot counters and the
+// top files table. Once the table is full a new file replaces the
+// least accessed one and inherits its count (the space-saving
+// heavy hitters scheme): busy files keep close counts while rare
+// ones come and go.
+void
+snap_tally(struct snap_counters *c, struct snap_file *files, int *nfiles, struct file_access_log *log)
+{
+    int op = op_code(log->operation);
+    struct snap_file *f = 0;
+
+    if(c->retained == 0 || log->seq < c->first_seq) {
+        c->first_seq = log->seq;
+    }
+    c->retained++;
+    c->ops[op] += log->repeat;
+    if(!log->status) {
+        c->failures += log->repeat;
+    }
+    if(op == OP_READ && log->bytes_transferred > 0) {
+        c->bytes_read += log->bytes_transferred;
+    } else if(op == OP_WRITE && log->bytes_transferred > 0) {
+        c->bytes_written += log->bytes_transferred;
+    }
+
+    for(int i = 0; i < *nfiles; i++) {
+        if(strncmp(files[i].filename, log->filename, FILENAME_MAX) == 0) {
+            f = &files[i];
+            break;
+        }
+    }
+    if(f == 0) {
+        int inherit = 0;
+        if(*nfiles < SNAP_MAXFILES) {
+            f = &files[(*nfiles)++];
+        } else {
+            f = &files[0];
+            for(int i = 1; i < SNAP_MAXFILES; i++) {
+                if(files[i].accesses < f->accesses) {
+                    f = &files[i];
+                }
+            }
+            inherit = f->accesses;
+        }
+        memset(f, 0, sizeof(*f));
+        safestrcpy(f->filename, log->filename, sizeof(f->filename));
+        f->accesses = inherit;
+    }
+    f->accesses += log->repeat;
+    if(op == OP_READ) {
+        f->reads += log->repeat;
+    } else if(op == OP_WRITE) {
+        f->writes += log->repeat;
+    }
+    if(!log->status) {
+        f->failures += log->repeat;
+    }
+    if(log->bytes_transferred > 0) {
+        f->bytes += log->bytes_transferred;
+    }
+}
+
+// Fill the n sections described at user_secs in one pass: recent
+// records, top files, counters and history metadata, all as of the
+// same record sequence number, less any history chunk evicted while
+// it is tallied. Returns 0, or -1 on a bad section.
+int
+snapshot(uint64 user_secs, int n)
+{
+    struct snap_section secs[SNAP_MAXSECTIONS];
+    struct snap_counters counters;
+    struct snap_history hist;
+    struct proc *p = myproc();
+    int nfiles = 0;
+    int r = 0;
+
+    if(n <= 0 || n > SNAP_MAXSECTIONS) {
+        return -1;
+    }
+    if(copyin(p->pagetable, (char*)secs, user_secs, n * sizeof(secs[0])) < 0) {
+        return -1;
+    }
+
+    // the files table and the copy of the buffer do not fit on
+    // the kernel stack
+    struct snap_file *files = (struct snap_file*)kalloc();
+    if(files == 0) {
+        return -1;
+    }
+    struct file_access_log *ring = (struct file_access_log*)kalloc();
+    if(ring == 0) {
+        kfree(files);
+        return -1;
+    }
+    memset(&counters, 0, sizeof(counters));
+
+    // Take the buffer and the history metadata under the log lock,
+    // after waiting out any full buffer on its way to history, so
+    // that both are as of the same record. The tallies are made
+    // afterwards, from the copy and chunk by chunk from history,
+    // leaving out anything logged since. Buffered records already
+    // in history count once.
+    acquire(&access_log_buffer.lock);
+    while(access_log_buffer.pending > 0) {
+        access_log_buffer.readers++;
+        sleep(&access_log_buffer.seq, &access_log_buffer.lock);
+        access_log_buffer.readers--;
+    }
+    history_snapshot(&hist);
+    memmove(ring, access_log_buffer.entries, sizeof(access_log_buffer.entries));
+    int next_index = access_log_buffer.next_index;
+    uint seq = access_log_buffer.seq;
+    counters.total_accesses = access_log_buffer.total_accesses;
+    counters.folded = access_log_buffer.folded;
+    release(&access_log_buffer.lock);
+
+    if(hist.total_logs > 0) {
+        history_tally(hist.last_seq, &counters, files, &nfiles);
+    }
+    for(int i = 0; i < MAX_LOG_ENTRIES; i++) {
+        struct file_access_log *entry = &ring[i];
+        if(!entry->valid) {
+            continue;
+        }
+        counters.buffered++;
+        if(hist.total_logs == 0 || entry->seq > hist.last_seq) {
+            snap_tally(&counters, files, &nfiles, entry);
+        }
+    }
+    if(counters.retained == 0) {
+        counters.first_seq = seq;
+    }
+
+    for(int i = 0; i < n && r == 0; i++) {
+        struct snap_section *s = &secs[i];
+        s->count = 0;
+        s->seq = seq;
+
+        if(s->type == SNAP_RECENT) {
+            for(int j = 0; j < MAX_LOG_ENTRIES && s->count < s->max; j++) {
+                int index = (next_index - 1 - j + MAX_LOG_ENTRIES) % MAX_LOG_ENTRIES;
+                struct file_access_log *entry = &ring[index];
+                if(!entry->valid) {
+                    continue;
+                }
+                if(copyout(p->pagetable, s->buf + s->count * sizeof(*entry),
+                           (char*)entry, sizeof(*entry)) < 0) {
+                    r = -1;
+                    break;
+                }
+                s->count++;
+            }
+        } else if(s->type == SNAP_TOPFILES) {
+            // selection sort, only as far as the caller wants
+            for(int j = 0; j < nfiles && s->count < s->max; j++) {
+                int top = j;
+                for(int k = j + 1; k < nfiles; k++) {
+                    if(files[k].accesses > files[top].accesses) {
+                        top = k;
+                    }
+                }
+                struct snap_file tmp = files[j];
+                files[j] = files[top];
+                files[top] = tmp;
+                if(copyout(p->pagetable, s->buf + s->count * sizeof(files[j]),
+                           (char*)&files[j], sizeof(files[j])) < 0) {
+                    r = -1;
+                    break;
+                }
+                s->count++;
+            }
+        } else if(s->type == SNAP_COUNTERS) {
+            if(s->max > 0) {
+                if(copyout(p->pagetable, s->buf, (char*)&counters, sizeof(counters)) < 0) {
+                    r = -1;
+                }
+                s->count = 1;
+            }
+        } else if(s->type == SNAP_HISTORY) {
+            if(s->max > 0) {
+                if(copyout(p->pagetable, s->buf, (char*)&hist, sizeof(hist)) < 0) {
+                    r = -1;
+                }
+                s->count = 1;
+            }
+        } else {
+            r = -1;
+        }
+    }
+    kfree(ring);
+    kfree(files);
+
+    if(r == 0 && copyout(p->pagetable, user_secs, (char*)secs, n * sizeof(secs[0])) < 0) {
+        r = -1;
+    }
+    return r;
+}
+
+// Copy up to max buffered entries with seq >= *cursor, oldest
+// first, to dst and advance *cursor past them.
+// Caller holds access_log_buffer.lock.
+static int
+ring_read(int user_dst, uint64 dst, int max, uint *cursor)
+{
+    int copied = 0;
+
+    for(int i = 0; i < MAX_LOG_ENTRIES && copied < max; i++) {
+        int index = (access_log_buffer.next_index + i) % MAX_LOG_ENTRIES;
+        struct file_access_log *entry = &access_log_buffer.entries[index];
+        if(!entry->valid || entry->seq < *cursor) {
+            continue;
+        }
+        if(either_copyout(user_dst, dst + copied * sizeof(*entry),
+                          (char*)entry, sizeof(*entry)) < 0) {
+            return -1;
+        }
+        *cursor = entry->seq + 1;
+        if(*cursor > access_log_buffer.read_seq) {
+            access_log_buffer.read_seq = *cursor;  // no more folding into it
+        }
+        copied++;
+    }
+    return copied;
+}
+
+// read() on the AUDITLOG device: stream whole records, history
+// first, from the cursor kept in f->off. AUDITLOG_FOLLOW reads
+// block until a record past the cursor exists; AUDITLOG_DUMP reads
+// return 0 instead. Records lost to history eviction are skipped.
+static int
+auditlog_read(struct file *f, int user_dst, uint64 dst, int n)
+{
+    int max = n / sizeof(struct file_access_log);
+    int follow = f->ip->minor != AUDITLOG_DUMP;
+    int copied;
+
+    if(max <= 0) {
+        return -1;
+    }
+
+    acquire(&access_log_buffer.lock);
+    for(;;) {
+        uint cursor = f->off;
+        copied = history_read(user_dst, dst, max, &cursor);
+        if(copied >= 0 && copied < max && access_log_buffer.pending == 0) {
+            int r = ring_read(user_dst, dst + copied * sizeof(struct file_access_log),
+                              max - copied, &cursor);
+            copied = r < 0 ? -1 : copied + r;
+        }
+        if(copied < 0) {
+            break;
+        }
+        f->off = cursor;
+        if(copied > 0 || (!follow && access_log_buffer.pending == 0)) {
+            break;
+        }
+
+        // caught up, or entries are in flight to history:
+        // wait for log_file_access()
+        if(killed(myproc())) {
+            copied = -1;
+            break;
+        }
+        access_log_buffer.readers++;
+        sleep(&access_log_buffer.seq, &access_log_buffer.lock);
+        access_log_buffer.readers--;
+    }
+    release(&access_log_buffer.lock);
+
+    return copied < 0 ? -1 : copied * sizeof(struct file_access_log);
+}
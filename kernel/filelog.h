@@ -12,15 +12,39 @@
 #define OP_CLOSE  4
 #define OP_CREATE 5
 #define OP_DELETE 6
+#define OP_CHDIR  7
+#define OP_EXEC   8   // this and below are logged by the syscall audit
+#define OP_LINK   9   // hook in kernel/syscall.c
+#define OP_MKDIR  10
+#define OP_MKNOD  11
+#define OP_DUP    12
+#define OP_PIPE   13
+#define OP_FORK   14
+#define NOPS      15
+
+// Minor numbers of the AUDITLOG device
+#define AUDITLOG_FOLLOW  0  // reads block until new records arrive
+#define AUDITLOG_DUMP    1  // reads return 0 once caught up
 
 struct file_access_log {
+    uint seq;    // record sequence number, never reset
     int pid;
+    int ppid;    // parent pid, 0 if none
+    int sid;     // session id
     char proc_name[16];
     char filename[FILENAME_MAX];
     char operation[OPERATION_MAX];
     int bytes_transferred;
+    int offset;  // file offset a READ/WRITE started at, -1 otherwise
     int status;  // 1 for success, 0 for failure
-    char timestamp[25];
+    uint time;   // seconds since 1970-01-01, see user/timefmt.c
+    int watch;   // WL_* flags of the watchlist entries covering filename
+    int audit;   // IA_* flags of the inode
+    uint inum;   // EXEC: inode number of the binary, 0 otherwise
+    uint64 hash;       // EXEC: hash of the ELF header and segments
+    uint64 argv_hash;  // EXEC: hash of the argument strings
+    uint repeat;     // times the event happened in a row, see log_record()
+    uint last_time;  // when it last happened
     int valid;
 };
 
@@ -32,4 +56,111 @@ struct file_stats {
     int total_bytes_written;
 };
 
+// Sealed history chunks form a hash chain: each chunk's mac is
+// SipHash-2-4, under the key from set_log_key(), of a struct
+// chunk_link naming the chunk before it. Clearing the history
+// leaves a sealed tombstone chunk holding one CLEAR record.
+struct chunk_link {
+    uint64 prev;     // mac of the chunk sealed before, 0 for the first
+    uint index;      // chunk number since boot, never reset
+    uint count;      // records in the chunk
+    uint64 body;     // SipHash-2-4 of the records
+};
+
+// A sealed chunk, as returned by get_history_chunk()
+struct chunk_meta {
+    struct chunk_link link;
+    uint64 mac;      // SipHash-2-4 of link
+    uint sealed;     // tick it was sealed
+    int keyed;       // 0 if sealed before set_log_key(), under a zero key
+};
+
+// Each history chunk is exported to the host as one frame: this
+// header followed by count records. See kernel/filelog_history.c
+// and auditdec/auditdec.c.
+#define EXPORT_MAGIC  0x474c5541  // "AULG"
+
+struct export_frame {
+    uint magic;      // EXPORT_MAGIC
+    uint count;      // records that follow
+    uint dropped;    // frames the exporter dropped before this one
+    uint sum;        // FNV-1a hash of the records
+    struct chunk_link link;  // the chunk's place in the chain
+    uint64 mac;      // SipHash-2-4 of link
+    int keyed;       // 0 if sealed under a zero key
+};
+
+// snapshot(): fill several sections in one call, all taken at
+// the same point in the log, the log sequence number in seq
+#define SNAP_RECENT    1  // newest records first, struct file_access_log[]
+#define SNAP_TOPFILES  2  // most accessed files, struct snap_file[]
+#define SNAP_COUNTERS  3  // one struct snap_counters
+#define SNAP_HISTORY   4  // one struct snap_history
+
+#define SNAP_MAXSECTIONS  8
+#define SNAP_MAXFILES     32  // distinct files SNAP_TOPFILES tracks
+
+struct snap_section {
+    int type;    // SNAP_*
+    int max;     // entries buf has room for
+    uint64 buf;  // user buffer
+    int count;   // out: entries filled in
+    uint seq;    // out: sequence number of the next record
+};
+
+// Counters and top files cover every retained record, in the
+// short-term buffer and in history alike
+struct snap_file {
+    char filename[FILENAME_MAX];
+    int accesses;   // approximate once more than SNAP_MAXFILES files
+    int reads;
+    int writes;
+    int failures;
+    uint bytes;     // bytes read or written
+};
+
+struct snap_counters {
+    uint first_seq;       // oldest record retained, seq if none
+    int total_accesses;   // events logged since the last clear
+    int folded;           // of which folded into the record before
+    int buffered;         // records in the short-term buffer
+    int retained;         // records in the buffer and history
+    int ops[NOPS];        // retained events per OP_*, repeats included
+    int failures;         // retained events that failed
+    uint bytes_read;
+    uint bytes_written;
+};
+
+struct snap_history {
+    int total_logs;
+    int total_chunks;
+    uint first_seq;       // oldest record in history
+    uint last_seq;        // newest record in history
+    uint oldest;          // tick the oldest chunk was sealed
+    uint newest;          // tick the newest chunk was sealed
+    uint export_dropped;  // chunks the exporter could not send
+};
+
+// Retention classes, each with its own overflow policy
+#define LOG_BUFFER   0  // the short-term buffer, drained into history
+#define LOG_HISTORY  1  // history chunks
+#define NLOGCLASS    2
+
+// What a full class does with the next records
+#define LOG_OVERWRITE  0  // make room by losing the oldest (the default)
+#define LOG_DROP_NEW   1  // refuse the new records
+#define LOG_BLOCK      2  // make producers wait for room
+
+// A full buffer is one history refused. A full history under
+// LOG_BLOCK makes room only by evicting chunks that were drained,
+// sent to the host or read with get_history_chunk(), and refuses
+// the buffer otherwise, leaving the buffer's policy to decide.
+struct log_class_stats {
+    int policy;        // LOG_*
+    uint overwritten;  // records lost to newer ones before being drained
+    uint dropped;      // records refused
+    uint blocked;      // LOG_BUFFER: times a producer waited;
+                       // LOG_HISTORY: times the buffer was refused
+};
+
 #endif
\ No newline at end of file
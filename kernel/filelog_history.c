@@ -14,6 +14,10 @@ struct file_access_log_chunk {
     struct file_access_log_chunk *next;
     int count;  // number of logs in this chunk (0-CHUNK_SIZE)
     uint transfer_time; // when this chunk was created
+    struct chunk_link link;  // its place in the hash chain
+    uint64 mac;
+    int keyed;
+    int drained;  // sent to the host or read by get_history_chunk()
 };
 
 struct history_storage {
@@ -22,6 +26,15 @@ struct history_storage {
     struct file_access_log_chunk *tail;
     int total_logs;
     int total_chunks;
+    uint export_dropped;  // chunks the exporter could not send
+    uint next_chunk;      // index of the next chunk sealed
+    uint64 last_mac;      // mac of the last chunk sealed
+    uint64 key[2];        // set_log_key(), once
+    int keyed;
+    int policy;           // LOG_* when full
+    uint overwritten;     // undrained records evicted
+    uint dropped;         // records refused under LOG_DROP_NEW
+    uint blocked;         // buffers refused under LOG_BLOCK
 } history_log_storage;
 
 // Initialize history storage
@@ -33,9 +46,165 @@ history_log_init(void)
     history_log_storage.tail = 0;
     history_log_storage.total_logs = 0;
     history_log_storage.total_chunks = 0;
+    history_log_storage.export_dropped = 0;
+
+    // a chunk, and an export frame of one, each fill one kalloc() page
+    if(sizeof(struct file_access_log_chunk) > PGSIZE ||
+       sizeof(struct export_frame) + CHUNK_SIZE * sizeof(struct file_access_log) > PGSIZE) {
+        panic("history_log_init: chunk too big for a page");
+    }
+}
+
+// FNV-1a hash of n bytes, the export frame checksum
+static uint
+export_sum(char *p, int n)
+{
+    uint h = 2166136261;
+    for(int i = 0; i < n; i++) {
+        h = (h ^ (uchar)p[i]) * 16777619;
+    }
+    return h;
+}
+
+// Send sealed chunk c to the host over the virtio console, its
+// link and mac in the frame header so that the host can check the
+// chain. The frame page is handed to the device, which reads it
+// by DMA; the driver frees it on the completion interrupt. Frames
+// that cannot be sent right away are dropped and counted, never
+// waited for. Called as c is sealed, so that frames go out in
+// chain order. Returns 0 if the frame was sent.
+// Caller holds history_log_storage.lock.
+static int
+export_chunk(struct file_access_log_chunk *c)
+{
+    struct export_frame *frame = (struct export_frame*)kalloc();
+    if(frame) {
+        int len = c->count * sizeof(struct file_access_log);
+        frame->magic = EXPORT_MAGIC;
+        frame->count = c->count;
+        frame->dropped = history_log_storage.export_dropped;
+        frame->link = c->link;
+        frame->mac = c->mac;
+        frame->keyed = c->keyed;
+        memmove(frame + 1, c->logs, len);
+        frame->sum = export_sum((char*)(frame + 1), len);
+        if(virtio_console_send(frame, sizeof(*frame) + len) == 0) {
+            return 0;
+        }
+        kfree(frame);
+    }
+    history_log_storage.export_dropped++;
+    return -1;
+}
+
+// Seal chunk c onto the hash chain and export it. The records are
+// hashed once here, when the chunk is drained, never per record.
+// Caller holds history_log_storage.lock.
+static void
+seal_chunk(struct file_access_log_chunk *c)
+{
+    uint64 *key = history_log_storage.key;
+
+    c->link.prev = history_log_storage.last_mac;
+    c->link.index = history_log_storage.next_chunk++;
+    c->link.count = c->count;
+    c->link.body = siphash(key[0], key[1], c->logs, c->count * sizeof(c->logs[0]));
+    c->mac = siphash(key[0], key[1], &c->link, sizeof(c->link));
+    c->keyed = history_log_storage.keyed;
+    history_log_storage.last_mac = c->mac;
+    c->drained = export_chunk(c) == 0;
+}
+
+// Append sealed chunk c to the history.
+// Caller holds history_log_storage.lock.
+static void
+append_chunk(struct file_access_log_chunk *c)
+{
+    c->next = 0;
+    if(!history_log_storage.head) {
+        history_log_storage.head = history_log_storage.tail = c;
+    } else {
+        history_log_storage.tail->next = c;
+        history_log_storage.tail = c;
+    }
+    history_log_storage.total_logs += c->count;
+    history_log_storage.total_chunks++;
 }
 
-// Transfer logs from short-term buffer to history storage
+// Set the chain key. It can be set once, so that whoever later
+// gets to make system calls cannot rekey and forge the chain.
+int
+set_log_key(uint64 k0, uint64 k1)
+{
+    acquire(&history_log_storage.lock);
+    if(history_log_storage.keyed) {
+        release(&history_log_storage.lock);
+        return -1;
+    }
+    history_log_storage.key[0] = k0;
+    history_log_storage.key[1] = k1;
+    history_log_storage.keyed = 1;
+    release(&history_log_storage.lock);
+    return 0;
+}
+
+// Copy out the metadata and records of the oldest chunk whose index
+// is at least index. Returns -1 if there is none.
+int
+get_history_chunk(uint index, uint64 user_meta, uint64 user_logs)
+{
+    struct chunk_meta meta;
+    struct file_access_log_chunk *chunk;
+
+    acquire(&history_log_storage.lock);
+    for(chunk = history_log_storage.head; chunk; chunk = chunk->next) {
+        if(chunk->link.index >= index) {
+            break;
+        }
+    }
+    if(chunk == 0) {
+        release(&history_log_storage.lock);
+        return -1;
+    }
+    meta.link = chunk->link;
+    meta.mac = chunk->mac;
+    meta.sealed = chunk->transfer_time;
+    meta.keyed = chunk->keyed;
+    if(copyout(myproc()->pagetable, user_meta, (char*)&meta, sizeof(meta)) < 0 ||
+       copyout(myproc()->pagetable, user_logs, (char*)chunk->logs,
+               chunk->count * sizeof(chunk->logs[0])) < 0) {
+        release(&history_log_storage.lock);
+        return -1;
+    }
+    // the caller has the chunk now, and a blocked buffer may have
+    // been waiting for it to become evictable
+    int wake = !chunk->drained && history_log_storage.policy == LOG_BLOCK;
+    chunk->drained = 1;
+    release(&history_log_storage.lock);
+    if(wake) {
+        filelog_drained();
+    }
+    return 0;
+}
+
+// A new unsealed chunk holding a copy of the count logs, or 0
+static struct file_access_log_chunk*
+alloc_chunk(struct file_access_log *logs, int count)
+{
+    struct file_access_log_chunk *c = (struct file_access_log_chunk*)kalloc();
+    if(c) {
+        memset(c, 0, sizeof(*c));
+        memmove(c->logs, logs, count * sizeof(logs[0]));
+        c->count = count;
+        c->transfer_time = ticks;
+    }
+    return c;
+}
+
+// Transfer logs from short-term buffer to history storage.
+// Returns 0 once the logs are in history, or were dropped under
+// LOG_DROP_NEW, and -1 if history refused them and the buffer has
+// to keep them.
 int
 transfer_to_history(struct file_access_log *buffer, int count)
 {
@@ -43,55 +212,76 @@ transfer_to_history(struct file_access_log *buffer, int count)
         return -1;
     }
 
+    struct file_access_log_chunk *new_chunk = alloc_chunk(buffer, count);
+    if(!new_chunk) {
+        printf("Error: Failed to allocate memory for history log chunk\n");
+        return -1;
+    }
+
     // Check if we've reached maximum chunks (memory management)
+    int keep = 1;
     acquire(&history_log_storage.lock);
     if(history_log_storage.total_chunks >= MAX_CHUNKS) {
+        struct file_access_log_chunk *old_head = history_log_storage.head;
+        if(history_log_storage.policy == LOG_DROP_NEW) {
+            keep = 0;
+        } else if(history_log_storage.policy == LOG_BLOCK && old_head && !old_head->drained) {
+            history_log_storage.blocked++;
+            release(&history_log_storage.lock);
+            kfree(new_chunk);
+            return -1;
+        }
         // Remove oldest chunk to make space
-        if(history_log_storage.head) {
-            struct file_access_log_chunk *old_head = history_log_storage.head;
+        if(keep && old_head) {
             history_log_storage.head = old_head->next;
             if(history_log_storage.head == 0) {
                 history_log_storage.tail = 0;
             }
             history_log_storage.total_logs -= old_head->count;
             history_log_storage.total_chunks--;
+            if(!old_head->drained) {
+                history_log_storage.overwritten += old_head->count;
+            }
             kfree(old_head);
         }
     }
-    release(&history_log_storage.lock);
 
-    // Allocate new chunk
-    struct file_access_log_chunk *new_chunk = (struct file_access_log_chunk*)kalloc();
-    if(!new_chunk) {
-        printf("Error: Failed to allocate memory for history log chunk\n");
-        return -1;
+    // Seal and export the chunk even under LOG_DROP_NEW, so that the
+    // host still gets it: only the in-kernel copy is dropped, its
+    // index showing up as a gap in the in-kernel chain.
+    seal_chunk(new_chunk);
+    if(keep) {
+        append_chunk(new_chunk);
+    } else {
+        history_log_storage.dropped += count;
     }
-
-    // Initialize the chunk properly
-    memset(new_chunk, 0, sizeof(struct file_access_log_chunk));
-    
-    // Copy logs from buffer to chunk
-    for(int i = 0; i < count; i++) {
-        new_chunk->logs[i] = buffer[i];
+    release(&history_log_storage.lock);
+    if(!keep) {
+        kfree(new_chunk);
     }
-    new_chunk->count = count;
-    new_chunk->next = 0;
-    new_chunk->transfer_time = ticks;
 
-    // Add chunk to linked list
+    return 0;
+}
+
+// Set the policy of a full history, LOG_*.
+void
+history_set_policy(int policy)
+{
     acquire(&history_log_storage.lock);
-    if(!history_log_storage.head) {
-        history_log_storage.head = history_log_storage.tail = new_chunk;
-    } else {
-        history_log_storage.tail->next = new_chunk;
-        history_log_storage.tail = new_chunk;
-    }
-    
-    history_log_storage.total_logs += count;
-    history_log_storage.total_chunks++;
+    history_log_storage.policy = policy;
     release(&history_log_storage.lock);
+}
 
-    return 0;
+// Fill in the LOG_HISTORY policy and counters.
+void
+history_policy_stats(struct log_class_stats *st)
+{
+    acquire(&history_log_storage.lock);
+    st->policy = history_log_storage.policy;
+    st->overwritten = history_log_storage.overwritten;
+    st->dropped = history_log_storage.dropped;
+    st->blocked = history_log_storage.blocked;
+    release(&history_log_storage.lock);
 }
 
 // Get logs from history storage (for system calls)
@@ -137,6 +327,89 @@ get_history_logs(uint64 user_buf, int max_entries, int offset)
     return copied;
 }
 
+// Copy up to max logs with seq >= *cursor, oldest first, to dst
+// and advance *cursor past them. Logs whose chunk was already
+// evicted are skipped. Returns the number of logs copied, or -1.
+int
+history_read(int user_dst, uint64 dst, int max, uint *cursor)
+{
+    int copied = 0;
+
+    acquire(&history_log_storage.lock);
+
+    struct file_access_log_chunk *chunk = history_log_storage.head;
+    for(; chunk && copied < max; chunk = chunk->next) {
+        if(chunk->count == 0 || chunk->logs[chunk->count - 1].seq < *cursor) {
+            continue;
+        }
+        for(int i = 0; i < chunk->count && copied < max; i++) {
+            struct file_access_log *log = &chunk->logs[i];
+            if(log->seq < *cursor) {
+                continue;
+            }
+            if(either_copyout(user_dst, dst + copied * sizeof(*log),
+                              (char*)log, sizeof(*log)) < 0) {
+                release(&history_log_storage.lock);
+                return -1;
+            }
+            *cursor = log->seq + 1;
+            copied++;
+        }
+    }
+
+    release(&history_log_storage.lock);
+    return copied;
+}
+
+// Fill in h as of now. See snapshot() in filelog.c.
+void
+history_snapshot(struct snap_history *h)
+{
+    memset(h, 0, sizeof(*h));
+
+    acquire(&history_log_storage.lock);
+    h->total_logs = history_log_storage.total_logs;
+    h->total_chunks = history_log_storage.total_chunks;
+    h->export_dropped = history_log_storage.export_dropped;
+
+    struct file_access_log_chunk *head = history_log_storage.head;
+    struct file_access_log_chunk *tail = history_log_storage.tail;
+    if(head) {
+        h->first_seq = head->logs[0].seq;
+        h->oldest = head->transfer_time;
+        h->last_seq = tail->logs[tail->count - 1].seq;
+        h->newest = tail->transfer_time;
+    }
+    release(&history_log_storage.lock);
+}
+
+// Tally the history logs with seq at most last into c and files.
+// The lock is taken once per chunk, so that a buffer being handed
+// over waits for one chunk's tally at most; a chunk evicted in
+// between is left out. See snapshot() in filelog.c.
+void
+history_tally(uint last, struct snap_counters *c, struct snap_file *files, int *nfiles)
+{
+    uint next = 0;  // index of the next chunk to tally
+
+    for(;;) {
+        acquire(&history_log_storage.lock);
+        struct file_access_log_chunk *chunk = history_log_storage.head;
+        while(chunk && chunk->link.index < next) {
+            chunk = chunk->next;
+        }
+        if(chunk == 0 || chunk->logs[0].seq > last) {
+            release(&history_log_storage.lock);
+            return;
+        }
+        for(int i = 0; i < chunk->count && chunk->logs[i].seq <= last; i++) {
+            snap_tally(c, files, nfiles, &chunk->logs[i]);
+        }
+        next = chunk->link.index + 1;
+        release(&history_log_storage.lock);
+    }
+}
+
 // Get history storage statistics
 void
 get_history_stats(int *total_logs, int *total_chunks)
@@ -147,11 +420,33 @@ get_history_stats(int *total_logs, int *total_chunks)
     release(&history_log_storage.lock);
 }
 
-// Clear history storage (free all chunks)
-void
-clear_history_logs(void)
+// Clear history storage (free all chunks), leaving in their place
+// a sealed tombstone chunk holding just tomb, which is told how many
+// records were erased. The stalled buffer, if any, and the nbuf
+// records logged since the last drain are not erased: they are
+// sealed ahead of the tombstone, their seqs being lower. Returns
+// -1, clearing nothing, if there is no memory for the chunks.
+// Caller holds access_log_buffer.lock, and no buffer is in flight.
+int
+history_clear(struct file_access_log *tomb, struct file_access_log *stalled,
+              struct file_access_log *buf, int nbuf)
 {
+    struct file_access_log_chunk *s = 0, *b = 0, *t;
+
+    if((stalled && (s = alloc_chunk(stalled, MAX_LOG_ENTRIES)) == 0) ||
+       (nbuf > 0 && (b = alloc_chunk(buf, nbuf)) == 0) ||
+       (t = alloc_chunk(tomb, 1)) == 0) {
+        if(s) {
+            kfree(s);
+        }
+        if(b) {
+            kfree(b);
+        }
+        return -1;
+    }
+
     acquire(&history_log_storage.lock);
+    t->logs[0].bytes_transferred = history_log_storage.total_logs;
     
     struct file_access_log_chunk *chunk = history_log_storage.head;
     while(chunk) {
@@ -164,6 +459,18 @@ clear_history_logs(void)
     history_log_storage.tail = 0;
     history_log_storage.total_logs = 0;
     history_log_storage.total_chunks = 0;
+
+    if(s) {
+        seal_chunk(s);
+        append_chunk(s);
+    }
+    if(b) {
+        seal_chunk(b);
+        append_chunk(b);
+    }
+    seal_chunk(t);
+    append_chunk(t);
     
     release(&history_log_storage.lock);
+    return 0;
 }
\ No newline at end of file
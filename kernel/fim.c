@@ -0,0 +1,237 @@
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+// File integrity monitoring. Each IA_FIM file gets a hash tree
+// over its data blocks: one leaf per block, FIM_ARITY children per
+// inner node, and a root that also covers the file size. writei()
+// only marks the blocks it touches dirty; fim() rehashes those and
+// the few inner nodes above, so a check costs in proportion to the
+// bytes changed since the last one, not to the file size.
+//
+// The tree lives in a side table, not the inode, so it survives the
+// inode leaving the inode cache. It is protected by the inode's
+// sleep lock: every caller holds it.
+
+#define FIM_ARITY  16
+#define FIM_LEAVES MAXFILE
+// leaves, plus an upper bound on the inner nodes
+#define FIM_NODES  (FIM_LEAVES + FIM_LEAVES / (FIM_ARITY - 1) + 8)
+
+// One page per tree
+struct fimpage {
+    uint64 node[FIM_NODES];  // leaves first, then each level up
+    char block[BSIZE];       // scratch for reading a block
+};
+
+struct fimtree {
+    uint dev;
+    uint inum;                  // 0 if the slot is free
+    struct fimpage *page;
+    int built;                  // every leaf hashed at least once
+    uchar dirty[(FIM_NODES + 7) / 8];  // nodes to rehash, numbered as in node[]
+    uint64 root;
+    uint64 baseline;
+    int has_baseline;
+};
+
+struct {
+    struct spinlock lock;  // protects dev and inum of the slots
+    struct fimtree trees[MAX_FIM];
+} fim_table;
+
+void
+fim_init(void)
+{
+    initlock(&fim_table.lock, "fim");
+    if(sizeof(struct fimpage) > PGSIZE) {
+        panic("fim_init: fimpage too big");
+    }
+}
+
+// The tree of ip, or 0. With alloc, make one if there is room.
+// Caller holds ip->lock.
+static struct fimtree*
+fim_tree(struct inode *ip, int alloc)
+{
+    struct fimtree *t, *free = 0;
+
+    acquire(&fim_table.lock);
+    for(t = fim_table.trees; t < &fim_table.trees[MAX_FIM]; t++) {
+        if(t->inum == ip->inum && t->dev == ip->dev) {
+            release(&fim_table.lock);
+            return t;
+        }
+        if(t->inum == 0 && free == 0) {
+            free = t;
+        }
+    }
+    if(!alloc || free == 0) {
+        release(&fim_table.lock);
+        return 0;
+    }
+    free->dev = ip->dev;
+    free->inum = ip->inum;
+    release(&fim_table.lock);
+
+    free->page = (struct fimpage*)kalloc();
+    if(free->page == 0) {
+        acquire(&fim_table.lock);
+        free->inum = 0;
+        release(&fim_table.lock);
+        return 0;
+    }
+    free->built = 0;
+    free->has_baseline = 0;
+    return free;
+}
+
+#define FIM_DIRTY(t, n)  ((t)->dirty[(n) / 8] & (1 << ((n) % 8)))
+
+static void
+fim_mark(struct fimtree *t, int n)
+{
+    t->dirty[n / 8] |= 1 << (n % 8);
+}
+
+// writei() is about to change block bn of ip.
+// Caller holds ip->lock.
+void
+fim_dirty(struct inode *ip, uint bn)
+{
+    struct fimtree *t = fim_tree(ip, 0);
+    if(t && bn < FIM_LEAVES) {
+        fim_mark(t, bn);
+    }
+}
+
+// ip was truncated: every leaf may have changed.
+// Caller holds ip->lock.
+void
+fim_truncated(struct inode *ip)
+{
+    struct fimtree *t = fim_tree(ip, 0);
+    if(t) {
+        t->built = 0;
+    }
+}
+
+// Drop the tree and baseline of ip, if any.
+// Caller holds ip->lock.
+void
+fim_forget(struct inode *ip)
+{
+    struct fimtree *t = fim_tree(ip, 0);
+    if(t == 0) {
+        return;
+    }
+    kfree(t->page);
+    t->page = 0;
+    acquire(&fim_table.lock);
+    t->inum = 0;
+    release(&fim_table.lock);
+}
+
+// Rehash the dirty leaves, or all of them on the first pass,
+// then the inner nodes above them and the root. Each rehashed
+// node marks its parent dirty.
+static int
+fim_update(struct fimtree *t, struct inode *ip)
+{
+    struct fimpage *pg = t->page;
+    uint nblocks = (ip->size + BSIZE - 1) / BSIZE;
+    int all = !t->built;
+
+    for(uint bn = 0; bn < FIM_LEAVES; bn++) {
+        if(!all && t->dirty[bn / 8] == 0) {
+            bn |= 7;  // skip the whole clean byte
+            continue;
+        }
+        if(!all && !FIM_DIRTY(t, bn)) {
+            continue;
+        }
+        uint64 h = 0;
+        if(bn < nblocks) {
+            uint off = bn * BSIZE;
+            uint n = ip->size - off < BSIZE ? ip->size - off : BSIZE;
+            if(readi(ip, 0, (uint64)pg->block, off, n) != n) {
+                return -1;
+            }
+            h = hash64(bn + 1, pg->block, n);
+        }
+        pg->node[bn] = h;
+        fim_mark(t, FIM_LEAVES + bn / FIM_ARITY);
+    }
+
+    // each level up hashes groups of FIM_ARITY nodes of the one below
+    int base = 0;
+    int width = FIM_LEAVES;
+    while(width > 1) {
+        int up = (width + FIM_ARITY - 1) / FIM_ARITY;
+        for(int i = 0; i < up; i++) {
+            if(!all && !FIM_DIRTY(t, base + width + i)) {
+                continue;
+            }
+            if(up > 1) {
+                fim_mark(t, base + width + up + i / FIM_ARITY);
+            }
+            int n = width - i * FIM_ARITY;
+            if(n > FIM_ARITY) {
+                n = FIM_ARITY;
+            }
+            pg->node[base + width + i] =
+                hash64(0, &pg->node[base + i * FIM_ARITY], n * sizeof(uint64));
+        }
+        base += width;
+        width = up;
+    }
+    memset(t->dirty, 0, sizeof(t->dirty));
+    t->built = 1;
+    t->root = hash64(pg->node[base], &ip->size, sizeof(ip->size));
+    return 0;
+}
+
+// Run fim() operation op (FIM_*) on ip, storing the current root
+// hash in *root; FIM_LOAD takes the baseline from *root instead.
+// Returns 0, or for FIM_CHECK 1 if the root differs from the
+// baseline. Returns -1 if ip is not IA_FIM, has no baseline to
+// check against, or its tree cannot be kept.
+// Caller holds ip->lock.
+int
+fim(struct inode *ip, int op, uint64 *root)
+{
+    struct fimtree *t;
+
+    if(!(ip->audit & IA_FIM) || (t = fim_tree(ip, 1)) == 0) {
+        return -1;
+    }
+
+    if(op == FIM_LOAD) {
+        t->baseline = *root;
+        t->has_baseline = 1;
+        return 0;
+    }
+
+    if(fim_update(t, ip) < 0) {
+        return -1;
+    }
+    *root = t->root;
+
+    if(op == FIM_BASELINE) {
+        t->baseline = t->root;
+        t->has_baseline = 1;
+    } else if(op == FIM_CHECK) {
+        if(!t->has_baseline) {
+            return -1;
+        }
+        return t->root != t->baseline;
+    } else if(op != FIM_ROOT) {
+        return -1;
+    }
+    return 0;
+}
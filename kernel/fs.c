@@ -231,6 +231,7 @@ iupdate(struct inode *ip)
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
+  dip->audit = ip->audit;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
@@ -304,12 +305,14 @@ ilock(struct inode *ip)
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
+    ip->audit = dip->audit;
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->texthashed = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -348,7 +351,10 @@ iput(struct inode *ip)
     release(&itable.lock);
 
     itrunc(ip);
+    if(ip->audit & IA_FIM)
+      fim_forget(ip);
     ip->type = 0;
+    ip->audit = 0;
     iupdate(ip);
     ip->valid = 0;
 
@@ -449,6 +455,9 @@ itrunc(struct inode *ip)
   }
 
   ip->size = 0;
+  ip->texthashed = 0;
+  if(ip->audit & IA_FIM)
+    fim_truncated(ip);
   iupdate(ip);
 }
 
@@ -513,7 +522,12 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  // the cached exec hash no longer holds
+  ip->texthashed = 0;
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    if(ip->audit & IA_FIM)
+      fim_dirty(ip, off/BSIZE);
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
@@ -30,7 +30,8 @@ struct superblock {
 
 // On-disk inode structure
 struct dinode {
-  short type;           // File type
+  uchar type;           // File type
+  uchar audit;          // Audit flags (IA_*)
   short major;          // Major device number (T_DEVICE only)
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
@@ -38,6 +39,12 @@ struct dinode {
   uint addrs[NDIRECT+1];   // Data block addresses
 };
 
+// Inode audit flags, kept on disk so they follow the inode
+// through links and renames.
+#define IA_AUDIT   0x1   // log every access, bypassing the log filters
+#define IA_CANARY  0x2   // decoy file: any open or unlink raises an alert
+#define IA_FIM     0x4   // integrity monitored: keep a hash tree of its blocks
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -0,0 +1,156 @@
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+
+// Inode watches. watch() hangs an iwatch off the in-memory inode,
+// holding a reference so the inode stays in the inode table, and
+// returns a descriptor that reads struct iwatch_events. The open,
+// write and unlink paths queue events only if ip->watches is set,
+// so an unwatched inode costs them one pointer test.
+
+struct iwatch {
+    struct inode *ip;       // 0 if the slot is free
+    struct iwatch *next;    // on ip->watches
+    int mask;               // IW_* events wanted
+    struct iwatch_event q[IWATCH_QUEUE];
+    uint head, tail;        // read at head, queued at tail
+    uint dropped;           // events lost to a full queue
+};
+
+struct {
+    struct spinlock lock;  // protects every watch and ip->watches
+    struct iwatch watches[MAX_IWATCH];
+} iwatch_table;
+
+void
+iwatch_init(void)
+{
+    initlock(&iwatch_table.lock, "iwatch");
+}
+
+// Watch ip for the events in mask, taking over the caller's
+// reference to ip. Returns 0 if every watch is in use.
+struct iwatch*
+iwatch_alloc(struct inode *ip, int mask)
+{
+    struct iwatch *w;
+
+    acquire(&iwatch_table.lock);
+    for(w = iwatch_table.watches; w < &iwatch_table.watches[MAX_IWATCH]; w++) {
+        if(w->ip == 0) {
+            w->ip = ip;
+            w->mask = mask;
+            w->head = w->tail = 0;
+            w->dropped = 0;
+            w->next = ip->watches;
+            ip->watches = w;
+            release(&iwatch_table.lock);
+            return w;
+        }
+    }
+    release(&iwatch_table.lock);
+    return 0;
+}
+
+// Detach w from its inode and free it. The caller drops the
+// inode reference that w held.
+void
+iwatch_close(struct iwatch *w)
+{
+    struct iwatch **pp;
+
+    acquire(&iwatch_table.lock);
+    for(pp = &w->ip->watches; *pp; pp = &(*pp)->next) {
+        if(*pp == w) {
+            *pp = w->next;
+            break;
+        }
+    }
+    w->ip = 0;
+    w->next = 0;
+    release(&iwatch_table.lock);
+}
+
+// Queue event (one IW_* bit) on every watch of ip that wants it.
+// Callers test ip->watches first; that unlocked test may miss a
+// watch being attached at the same moment, which is harmless.
+void
+iwatch_event(struct inode *ip, int event)
+{
+    struct proc *p = myproc();
+    struct iwatch *w;
+
+    acquire(&iwatch_table.lock);
+    for(w = ip->watches; w; w = w->next) {
+        if(!(w->mask & event)) {
+            continue;
+        }
+        if(w->tail - w->head == IWATCH_QUEUE) {
+            w->dropped++;
+            continue;
+        }
+        struct iwatch_event *e = &w->q[w->tail++ % IWATCH_QUEUE];
+        e->mask = event;
+        e->inum = ip->inum;
+        e->pid = p->pid;
+        e->tick = ticks;
+        e->count = 1;
+        safestrcpy(e->proc_name, p->name, sizeof(e->proc_name));
+        wakeup(w);
+    }
+    release(&iwatch_table.lock);
+}
+
+// Read whole events from w into addr, waiting for at least one.
+// Dropped events are reported first, as one IW_OVERFLOW event.
+// Returns the number of bytes read, or -1.
+int
+iwatch_read(struct iwatch *w, uint64 addr, int n)
+{
+    struct proc *p = myproc();
+    struct iwatch_event e;
+    int copied = 0;
+
+    if(n < sizeof(e)) {
+        return -1;
+    }
+
+    acquire(&iwatch_table.lock);
+    while(w->head == w->tail && w->dropped == 0) {
+        if(killed(p)) {
+            release(&iwatch_table.lock);
+            return -1;
+        }
+        sleep(w, &iwatch_table.lock);
+    }
+
+    if(w->dropped) {
+        memset(&e, 0, sizeof(e));
+        e.mask = IW_OVERFLOW;
+        e.inum = w->ip->inum;
+        e.tick = ticks;
+        e.count = w->dropped;
+        if(copyout(p->pagetable, addr, (char*)&e, sizeof(e)) < 0) {
+            release(&iwatch_table.lock);
+            return -1;
+        }
+        w->dropped = 0;
+        copied += sizeof(e);
+    }
+    while(w->head != w->tail && n - copied >= sizeof(e)) {
+        if(copyout(p->pagetable, addr + copied,
+                   (char*)&w->q[w->head % IWATCH_QUEUE], sizeof(e)) < 0) {
+            break;
+        }
+        w->head++;
+        copied += sizeof(e);
+    }
+    release(&iwatch_table.lock);
+    return copied > 0 ? copied : -1;
+}
@@ -28,10 +28,12 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    iwatch_init();   // inode watches
     filelog_init();  // Initialize file access logging
     history_log_init(); // Initialize history storage
     timeutil_init(); 
     virtio_disk_init(); // emulated hard disk
+    virtio_console_init(); // audit export channel
     userinit();      // first user process
     __sync_synchronize();
     started = 1;
@@ -4,6 +4,7 @@
 // based on qemu's hw/riscv/virt.c:
 //
 // 00001000 -- boot ROM, provided by qemu
+// 00101000 -- goldfish RTC
 // 02000000 -- CLINT
 // 0C000000 -- PLIC
 // 10000000 -- uart0 
@@ -17,6 +18,9 @@
 // end -- start of kernel page allocation area
 // PHYSTOP -- end RAM used by the kernel
 
+// goldfish real-time clock
+#define RTC0 0x101000L
+
 // qemu puts UART registers here in physical memory.
 #define UART0 0x10000000L
 #define UART0_IRQ 10
@@ -25,6 +29,10 @@
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
 
+// virtio mmio console, the audit export channel
+#define VIRTIO1 0x10002000
+#define VIRTIO1_IRQ 2
+
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
 #define PLIC_PRIORITY (PLIC + 0x0)
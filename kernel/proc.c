@@ -168,6 +168,9 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->throttle_until = 0;
+  p->sid = 0;
+  p->ppid = 0;
   p->state = UNUSED;
 }
 
@@ -248,6 +251,7 @@ userinit(void)
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
+  p->sid = p->pid;
 
   p->state = RUNNABLE;
 
@@ -309,6 +313,12 @@ fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->sid = p->sid;
+
+  // forking does not escape a throttle
+  np->throttle_until = p->throttle_until;
+  np->tokens = p->tokens;
+  np->token_tick = p->token_tick;
 
   pid = np->pid;
 
@@ -316,6 +326,7 @@ fork(void)
 
   acquire(&wait_lock);
   np->parent = p;
+  np->ppid = p->pid;
   release(&wait_lock);
 
   acquire(&np->lock);
@@ -325,6 +336,31 @@ fork(void)
   return pid;
 }
 
+// Return the pid of p's parent, 0 if it has none. Reads the
+// copy fork() and reparent() keep in p->ppid, without wait_lock:
+// a word-sized read sees either the old parent or init.
+int
+parentpid(struct proc *p)
+{
+  return p->ppid;
+}
+
+// Make the current process the root of a new session. Only a
+// process still in init's session may: once in a session of its
+// own, a process and all it forks stay there, so that children
+// cannot leave their parent's session to dodge the detector's
+// per-session rules. sh starts each command line this way.
+int
+setsid(void)
+{
+  struct proc *p = myproc();
+
+  if(p->sid != initproc->sid)
+    return -1;
+  p->sid = p->pid;
+  return p->sid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -335,6 +371,7 @@ reparent(struct proc *p)
   for(pp = proc; pp < &proc[NPROC]; pp++){
     if(pp->parent == p){
       pp->parent = initproc;
+      pp->ppid = initproc->pid;
       wakeup(initproc);
     }
   }
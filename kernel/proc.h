@@ -104,4 +104,17 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int sid;                     // Session id, pid of the session root
+  int ppid;                    // parent's pid, kept with parent so that
+                               // loggers need not take wait_lock
+
+  // File syscall throttling, set by RULE_ACT_THROTTLE rules
+  uint throttle_until;         // ticks; 0 if not throttled
+  uint tokens;                 // file syscalls allowed right now
+  uint token_tick;             // tick tokens were last refilled
+
+  // What the last exec ran, for the syscall audit hook
+  uint exec_inum;              // inode number, 0 if not found
+  uint64 exec_hash;            // hash of its ELF header and segments
+  uint64 exec_argv;            // hash of the argument strings
 };
@@ -0,0 +1,26 @@
+//
+// driver for the goldfish real-time clock that qemu's
+// virt machine puts at RTC0.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+
+// the RTC registers are memory-mapped at address RTC0.
+#define Reg(reg) ((volatile uint32 *)(RTC0 + (reg)))
+
+#define TIME_LOW   0x00  // low 32 bits of the time; reading it latches TIME_HIGH
+#define TIME_HIGH  0x04  // high 32 bits, as of the last TIME_LOW read
+
+// Read the wall-clock time in nanoseconds since 1970-01-01.
+// Returns 0 if there is no RTC.
+uint64
+rtc_read(void)
+{
+  uint64 lo = *Reg(TIME_LOW);
+  uint64 hi = *Reg(TIME_HIGH);
+  return (hi << 32) | lo;
+}
@@ -0,0 +1,84 @@
+#include "types.h"
+#include "siphash.h"
+
+// Built into the kernel, into the user library and into the host's
+// auditdec, so it uses nothing but the types.
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3) do { \
+  v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+  v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+  v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+  v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+} while(0)
+
+// SipHash-2-4 of n bytes at v under the 128-bit key (k0, k1):
+// a keyed hash that cannot be forged without the key.
+uint64
+siphash(uint64 k0, uint64 k1, const void *v, uint n)
+{
+  const uchar *p = v;
+  uint64 v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64 v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64 v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64 v3 = k1 ^ 0x7465646279746573ULL;
+  uint64 m;
+  uint i, left;
+
+  for(left = n; left >= 8; left -= 8, p += 8){
+    m = 0;
+    for(i = 0; i < 8; i++)
+      m |= (uint64)p[i] << (8*i);
+    v3 ^= m;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+
+  // the last block holds the leftover bytes and the length
+  m = (uint64)n << 56;
+  for(i = 0; i < left; i++)
+    m |= (uint64)p[i] << (8*i);
+  v3 ^= m;
+  SIPROUND(v0, v1, v2, v3);
+  SIPROUND(v0, v1, v2, v3);
+  v0 ^= m;
+
+  v2 ^= 0xff;
+  SIPROUND(v0, v1, v2, v3);
+  SIPROUND(v0, v1, v2, v3);
+  SIPROUND(v0, v1, v2, v3);
+  SIPROUND(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Parse the n (1 to 16) hex digits at s into *v.
+// Returns 0 if any of them is not a lower case hex digit.
+int
+hex64(const char *s, int n, uint64 *v)
+{
+  int i, d;
+
+  if(n < 1 || n > 16)
+    return 0;
+  *v = 0;
+  for(i = 0; i < n; i++){
+    if(s[i] >= '0' && s[i] <= '9')
+      d = s[i] - '0';
+    else if(s[i] >= 'a' && s[i] <= 'f')
+      d = s[i] - 'a' + 10;
+    else
+      return 0;
+    *v = (*v << 4) | d;
+  }
+  return 1;
+}
+
+// Parse a log key, 32 hex digits, into key[0] (the first 16) and
+// key[1]. Returns 0 if s is anything else.
+int
+parsekey(const char *s, uint64 *key)
+{
+  return hex64(s, 16, &key[0]) && hex64(s + 16, 16, &key[1]) && s[32] == 0;
+}
@@ -0,0 +1,6 @@
+// SipHash-2-4 and hex key parsing, shared by the kernel, the user
+// library and the host-side auditdec so that the sealer and the
+// verifiers cannot drift apart. See kernel/siphash.c.
+uint64 siphash(uint64 k0, uint64 k1, const void *v, uint n);
+int hex64(const char *s, int n, uint64 *v);
+int parsekey(const char *s, uint64 *key);
@@ -4,66 +4,1397 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "timeutil.h"
 
 extern uint ticks;
+extern struct spinlock tickslock;
+extern struct proc proc[NPROC];
 
-// Simple thresholds
-#define MAX_FAILED_ATTEMPTS 5
-#define MAX_RAPID_ACCESS 8
-#define TIME_WINDOW 3  // ticks
+// Alert suppression. Repeats of an alert from the same process and
+// source are coalesced into one alert per backoff interval, which
+// doubles while the source keeps firing. A global token bucket caps
+// the total alert rate. Firings still suppressed when the backoff
+// runs out, or when the process's slot is reused, are flushed as
+// one alert with no event details.
+#define ALERT_BACKOFF_MIN  TICKS_PER_SEC
+#define ALERT_BACKOFF_MAX  (64 * TICKS_PER_SEC)
+#define ALERT_BURST        20  // alerts that may be raised back to back
+#define ALERT_REFILL       2   // tokens added per tick
+
+// Throttling: a process that trips a RULE_ACT_THROTTLE rule may make
+// THROTTLE_RATE file syscalls per tick, in bursts of THROTTLE_BURST,
+// for THROTTLE_TICKS after it last tripped one
+#define THROTTLE_TICKS  (10 * TICKS_PER_SEC)
+#define THROTTLE_RATE   1
+#define THROTTLE_BURST  5
+
+// Session table. A slot whose session has been quiet for
+// SESSION_IDLE may be taken over by a new session.
+#define NSESSIONS     NPROC
+#define SESSION_IDLE  (60 * TICKS_PER_SEC)
+
+// One suppression slot per rule, then one per alert kind
+#define ALERT_SOURCES  (MAX_RULES + NALERTKINDS)
+
+// Sliding window: one slot per tick, covering one second, so the
+// window total is directly an events-per-second rate.
+#define RATE_SLOTS TICKS_PER_SEC
+
+// Ransomware pattern thresholds, in events per second
+#define RANSOM_REWRITE_RATE  5  // files read then overwritten in place
+#define RANSOM_REPLACE_RATE  3  // files read, replaced by a sibling, deleted
+#define RANSOM_FILES         8  // recently touched files tracked per process
+
+#define SEQ_FILES  4  // files tracked per process for sequential reads
+
+// Baseline learning
+#define BL_SHIFT        3   // EWMA weight of a new sample is 1/8
+#define BL_MIN_SAMPLES  20  // seconds learned before a program is scored
+#define BL_SCORE        8   // deviations above the mean that raise an alert
+#define BL_MAX_SAMPLE   (0xffffffff >> BL_FRAC)
+
+// HyperLogLog sketch of distinct paths: 2^HLL_BITS one-byte registers
+#define HLL_BITS  6
+#define HLL_REGS  (1 << HLL_BITS)
+#define HLL_ALPHA_MM  2904   // 0.709 * HLL_REGS^2, the bias correction
+
+// Hash table sizes for the compiled rule lookups
+#define PROC_BUCKETS   (2*MAX_RULES)
+#define PREFIX_BUCKETS (2*MAX_RULES)
+
+struct ratewin {
+    uint tick;                 // tick of the newest slot
+    uint total;                // sum of all slots
+    ushort slot[RATE_SLOTS];   // events seen in each tick
+};
+
+// A file the process recently read or wrote
+#define RF_READ   1
+#define RF_WROTE  2
+
+struct recent_file {
+    uint path;                 // hash of the path
+    uint dir;                  // hash of its parent directory
+    uint tick;                 // last time it was touched
+    int flags;                 // RF_*
+};
+
+// Per-process state machine for the "read, write new, delete
+// original" loop. Fixed size, so tracking costs O(1) per event.
+struct ransom_state {
+    struct recent_file files[RANSOM_FILES];
+    int next;                  // replacement cursor into files[]
+    struct ratewin rewrites;   // read files overwritten in place
+    struct ratewin replaces;   // read files deleted after a sibling write
+};
+
+// Contiguous read coverage of one file. A run that starts at
+// offset 0 and reaches the file size read the whole file.
+struct seqread {
+    uint inum;                 // inode number, 0 if unused
+    uint start;                // offset the current run started at
+    uint next;                 // offset just past the run
+    uint tick;                 // last read, for replacement
+};
+
+// A process's activity during one second, the unit baselines learn
+struct blsample {
+    uint sec;                  // ticks / TICKS_PER_SEC of the sample
+    uint ops;
+    uint fails;
+    uint bytes;
+    uint files[2];             // 64-bit bitmap of path hashes
+};
+
+// Distinct-file sketches of the current and the previous window
+struct hll {
+    uint win;                  // window number of cur
+    uchar cur[HLL_REGS];
+    uchar prev[HLL_REGS];
+};
+
+// Suppression state of one (process, alert source) pair
+struct alertsup {
+    uint next;                 // alerts are suppressed until this tick
+    uint backoff;              // current suppression interval
+    uint count;                // firings suppressed since the last alert
+    uint first;                // tick of the first suppressed firing
+    uint last;                 // tick of the latest suppressed firing
+    int kind;                  // ALERT_* of the suppressed firings
+    int pid;                   // process of the latest one
+};
+
+// Counters shared by all processes of a session, so a tree of
+// short-lived children is judged as a whole
+struct session {
+    int sid;                   // 0 if unused
+    uint gen;                  // rule table generation of win[]
+    uint last;                 // tick of the latest event
+    uint events;
+    uint failures;
+    struct ratewin ops;        // events in the last second
+    struct ratewin win[MAX_RULES];
+    struct hll files;
+    struct alertsup sup[MAX_RULES];
+};
+
+// Per-process detector state, indexed by proc table slot.
+// Only the owning process updates its slot, so no lock is needed,
+// except for sup[], which flush_alerts() also empties.
+struct actor {
+    int pid;                   // pid owning this slot, 0 if unused
+    char name[16];             // process name of its latest alert
+    uint gen;                  // rule table generation of win[]
+    struct ratewin win[MAX_RULES];
+    struct ransom_state ransom;
+    struct seqread seq[SEQ_FILES];
+    struct blsample bl;
+    struct hll files;
+    struct alertsup sup[ALERT_SOURCES];
+    struct session *sess;      // session of the latest event, 0 if none
+};
+
+// Rules compiled into bitmask lookups. Each table maps one event
+// attribute to the set of rules it satisfies, so evaluating an event
+// is a few hash probes and ANDs no matter how many rules are loaded.
+struct ruletab {
+    struct detect_rule rules[MAX_RULES];
+    int nrules;
+    uint gen;                         // bumped on every load
+    uint opst[NOPS][2];               // [op][status ok] -> rules
+    uint any_proc;                    // rules with no process filter
+    struct {
+        uint mask;
+        char name[16];
+    } procs[PROC_BUCKETS];
+    uint any_prefix;                  // rules with no path filter
+    struct {
+        uint hash;
+        uint len;
+        uint mask;
+        char text[RULE_PREFIX_MAX];   // normalized, see hash_prefix()
+    } prefixes[PREFIX_BUCKETS];
+    uint ignore;                      // RULE_ACT_IGNORE rules
+};
 
-// Simple tracking structure
 struct {
-    int failed_count;
-    int access_count;
-    uint last_access_time;
-    uint last_alert_time;
+    struct spinlock lock;             // protects rt
+    struct ruletab rt;
+    struct actor actors[NPROC];
+    struct session sessions[NSESSIONS];   // open addressing by sid
+    uint alert_tokens;                // global alert token bucket
+    uint alert_refill;                // tick the bucket was last refilled
+    uint alert_flushed;               // tick of the last flush_alerts()
+    struct prog_baseline baselines[MAX_BASELINES];
+    uint baseline_used[MAX_BASELINES];   // tick each was last sampled
+    int nbaselines;
 } simple_detector;
 
+// Built-in rules, loaded at boot and by set_detect_rules(0, -1)
+static struct detect_rule default_rules[] = {
+    { 0, RULE_ST_ANY,  0,  RULE_ACT_IGNORE, "init",     "" },
+    { 0, RULE_ST_ANY,  0,  RULE_ACT_IGNORE, "showlogs", "" },
+    { 0, RULE_ST_FAIL, 5,  RULE_ACT_ALERT,  "",         "" },
+    { 0, RULE_ST_OK,   20, RULE_ACT_ALERT,  "",         "" },
+};
+
+// Expire the slots that fell out of the window since the last event.
+// Bounded by RATE_SLOTS, so O(1) no matter how long the actor was idle.
+static void
+ratewin_advance(struct ratewin *w, uint now)
+{
+    uint gap = now - w->tick;
+
+    if(gap >= RATE_SLOTS) {
+        memset(w->slot, 0, sizeof(w->slot));
+        w->total = 0;
+    } else {
+        for(uint i = 1; i <= gap; i++) {
+            int idx = (w->tick + i) % RATE_SLOTS;
+            w->total -= w->slot[idx];
+            w->slot[idx] = 0;
+        }
+    }
+    w->tick = now;
+}
+
+// Record one event and return the number of events in the last second
+static uint
+ratewin_add(struct ratewin *w, uint now)
+{
+    ratewin_advance(w, now);
+    w->slot[now % RATE_SLOTS]++;
+    w->total++;
+    return w->total;
+}
+
+// FNV-1a, used for process names and path prefixes
+static uint
+hash_step(uint h, char c)
+{
+    return (h ^ (uchar)c) * 16777619;
+}
+
+static uint
+hash_str(char *s, int max)
+{
+    uint h = 2166136261;
+    for(int i = 0; i < max && s[i]; i++) {
+        h = hash_step(h, s[i]);
+    }
+    return h;
+}
+
+// Hash a path and, separately, the directory part before its last slash
+static uint
+hash_path(char *s, uint *dir)
+{
+    uint h = 2166136261;
+    uint d = h;
+
+    for(int i = 0; i < FILENAME_MAX && s[i]; i++) {
+        if(s[i] == '/') {
+            d = h;
+        }
+        h = hash_step(h, s[i]);
+    }
+    *dir = d;
+    return h;
+}
+
+// HLL_REGS * ln(HLL_REGS / v) for v empty registers, the
+// linear-counting estimate used while the sketch is sparse
+static ushort hll_linear[HLL_REGS + 1] = {
+    0, 266, 222, 196, 177, 163, 151, 142, 133, 126, 119, 113, 107,
+    102, 97, 93, 89, 85, 81, 78, 74, 71, 68, 65, 63, 60, 58, 55, 53,
+    51, 48, 46, 44, 42, 40, 39, 37, 35, 33, 32, 30, 28, 27, 25, 24,
+    23, 21, 20, 18, 17, 16, 15, 13, 12, 11, 10, 9, 7, 6, 5, 4, 3,
+    2, 1, 0,
+};
+
+// Start a new window if the current one is over. Only the last
+// finished window is kept, anything older is forgotten.
+static void
+hll_rotate(struct hll *h, uint now)
+{
+    uint win = now / (HLL_WINDOW * TICKS_PER_SEC);
+
+    if(win == h->win) {
+        return;
+    }
+    if(win == h->win + 1) {
+        memmove(h->prev, h->cur, HLL_REGS);
+    } else {
+        memset(h->prev, 0, HLL_REGS);
+    }
+    memset(h->cur, 0, HLL_REGS);
+    h->win = win;
+}
+
+static void
+hll_add(struct hll *h, uint hash)
+{
+    // FNV's high bits are weak; mix them before splitting
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+
+    int reg = hash >> (32 - HLL_BITS);
+    uint rest = hash << HLL_BITS;
+    uchar rank = 1;
+    while(rank <= 32 - HLL_BITS && !(rest & 0x80000000)) {
+        rank++;
+        rest <<= 1;
+    }
+    if(rank > h->cur[reg]) {
+        h->cur[reg] = rank;
+    }
+}
+
+// Estimate the number of distinct values in the union of the
+// given sketches, in integer arithmetic.
+static uint
+hll_estimate(uchar *a, uchar *b)
+{
+    uint64 sum = 0;   // sum of 2^-register, 32 fraction bits
+    int zeros = 0;
+
+    for(int i = 0; i < HLL_REGS; i++) {
+        uchar r = a[i];
+        if(b && b[i] > r) {
+            r = b[i];
+        }
+        if(r == 0) {
+            zeros++;
+        }
+        sum += (uint64)1 << (32 - r);
+    }
+
+    uint e = ((uint64)HLL_ALPHA_MM << 32) / sum;
+    if(e <= 5 * HLL_REGS / 2 && zeros > 0) {
+        e = hll_linear[zeros];
+    }
+    return e;
+}
+
+// Hash the leading components of a path prefix, ignoring leading and
+// repeated slashes, so "/etc/" and "etc" compile to the same key.
+// The normalized text goes in text, which has room for s.
+static uint
+hash_prefix(char *s, uint *len, char *text)
+{
+    uint h = 2166136261;
+    uint n = 0;
+
+    while(*s == '/') {
+        s++;
+    }
+    while(*s) {
+        if(*s == '/') {
+            while(*s == '/') {
+                s++;
+            }
+            if(*s == 0) {
+                break;
+            }
+            h = hash_step(h, '/');
+            text[n++] = '/';
+        }
+        h = hash_step(h, *s);
+        text[n++] = *s++;
+    }
+    text[n] = 0;
+    *len = n;
+    return h;
+}
+
+// Do the first len characters of path s, normalized as in
+// hash_prefix(), spell out text?
+static int
+prefix_equal(char *text, char *s, uint len)
+{
+    uint n = 0;
+
+    while(*s == '/') {
+        s++;
+    }
+    while(n < len && *s) {
+        if(*s == '/') {
+            while(*s == '/') {
+                s++;
+            }
+            if(*s == 0 || text[n++] != '/') {
+                return 0;
+            }
+            continue;
+        }
+        if(text[n++] != *s++) {
+            return 0;
+        }
+    }
+    return n == len;
+}
+
+// Rules whose process filter names this process
+static uint
+lookup_proc(struct ruletab *rt, char *name)
+{
+    uint b = hash_str(name, 16) % PROC_BUCKETS;
+
+    for(int i = 0; i < PROC_BUCKETS; i++) {
+        int idx = (b + i) % PROC_BUCKETS;
+        if(rt->procs[idx].mask == 0) {
+            return 0;
+        }
+        if(strncmp(rt->procs[idx].name, name, 16) == 0) {
+            return rt->procs[idx].mask;
+        }
+    }
+    return 0;
+}
+
+// Rules whose prefix is the first len characters of path, which
+// hash to h. The text is compared on a hash hit, since a colliding
+// component must not pick up another prefix's rules.
+static uint
+lookup_prefix_hash(struct ruletab *rt, uint h, uint len, char *path)
+{
+    uint b = h % PREFIX_BUCKETS;
+
+    for(int i = 0; i < PREFIX_BUCKETS; i++) {
+        int idx = (b + i) % PREFIX_BUCKETS;
+        if(rt->prefixes[idx].mask == 0) {
+            return 0;
+        }
+        if(rt->prefixes[idx].hash == h && rt->prefixes[idx].len == len &&
+           prefix_equal(rt->prefixes[idx].text, path, len)) {
+            return rt->prefixes[idx].mask;
+        }
+    }
+    return 0;
+}
+
+// Rules whose path prefix covers filename. Probes once per component
+// boundary while hashing the path, so the cost is O(path length).
+static uint
+lookup_prefix(struct ruletab *rt, char *s)
+{
+    uint h = 2166136261;
+    uint n = 0;
+    uint mask = 0;
+    char *path = s;
+
+    while(*s == '/') {
+        s++;
+    }
+    while(*s) {
+        if(*s == '/') {
+            mask |= lookup_prefix_hash(rt, h, n, path);
+            while(*s == '/') {
+                s++;
+            }
+            if(*s == 0) {
+                return mask;
+            }
+            h = hash_step(h, '/');
+            n++;
+        }
+        h = hash_step(h, *s++);
+        n++;
+    }
+    if(n > 0) {
+        mask |= lookup_prefix_hash(rt, h, n, path);
+    }
+    return mask;
+}
+
+// Build the lookup tables for rt->rules[0..nrules-1]
+static void
+compile_rules(struct ruletab *rt)
+{
+    memset(rt->opst, 0, sizeof(rt->opst));
+    memset(rt->procs, 0, sizeof(rt->procs));
+    memset(rt->prefixes, 0, sizeof(rt->prefixes));
+    rt->any_proc = 0;
+    rt->any_prefix = 0;
+    rt->ignore = 0;
+
+    for(int r = 0; r < rt->nrules; r++) {
+        struct detect_rule *rule = &rt->rules[r];
+        uint bit = 1 << r;
+
+        rule->proc_name[sizeof(rule->proc_name)-1] = 0;
+        rule->prefix[sizeof(rule->prefix)-1] = 0;
+
+        for(int op = 0; op < NOPS; op++) {
+            if(rule->opmask && !(rule->opmask & (1 << op))) {
+                continue;
+            }
+            if(rule->status != RULE_ST_OK) {
+                rt->opst[op][0] |= bit;
+            }
+            if(rule->status != RULE_ST_FAIL) {
+                rt->opst[op][1] |= bit;
+            }
+        }
+
+        if(rule->proc_name[0] == 0) {
+            rt->any_proc |= bit;
+        } else {
+            uint b = hash_str(rule->proc_name, 16) % PROC_BUCKETS;
+            for(int i = 0; i < PROC_BUCKETS; i++) {
+                int idx = (b + i) % PROC_BUCKETS;
+                if(rt->procs[idx].mask == 0 ||
+                   strncmp(rt->procs[idx].name, rule->proc_name, 16) == 0) {
+                    safestrcpy(rt->procs[idx].name, rule->proc_name, 16);
+                    rt->procs[idx].mask |= bit;
+                    break;
+                }
+            }
+        }
+
+        uint len;
+        char text[RULE_PREFIX_MAX];
+        uint h = hash_prefix(rule->prefix, &len, text);
+        if(len == 0) {
+            rt->any_prefix |= bit;
+        } else {
+            uint b = h % PREFIX_BUCKETS;
+            for(int i = 0; i < PREFIX_BUCKETS; i++) {
+                int idx = (b + i) % PREFIX_BUCKETS;
+                if(rt->prefixes[idx].mask == 0 ||
+                   (rt->prefixes[idx].hash == h && rt->prefixes[idx].len == len &&
+                    strncmp(rt->prefixes[idx].text, text, RULE_PREFIX_MAX) == 0)) {
+                    rt->prefixes[idx].hash = h;
+                    rt->prefixes[idx].len = len;
+                    safestrcpy(rt->prefixes[idx].text, text, RULE_PREFIX_MAX);
+                    rt->prefixes[idx].mask |= bit;
+                    break;
+                }
+            }
+        }
+
+        if(rule->action == RULE_ACT_IGNORE) {
+            rt->ignore |= bit;
+        }
+    }
+    rt->gen++;
+}
+
+// Take a token from the global alert bucket, 0 if it is empty
+static int
+alert_token(uint now)
+{
+    uint refill = (now - simple_detector.alert_refill) * ALERT_REFILL;
+
+    if(refill > 0) {
+        simple_detector.alert_tokens += refill;
+        if(simple_detector.alert_tokens > ALERT_BURST) {
+            simple_detector.alert_tokens = ALERT_BURST;
+        }
+        simple_detector.alert_refill = now;
+    }
+    if(simple_detector.alert_tokens == 0) {
+        return 0;
+    }
+    simple_detector.alert_tokens--;
+    return 1;
+}
+
+// Queue one alert for the firings pending in s, of rule rule (-1
+// for none) and session sid, once its backoff has run out and the
+// global bucket has a token, or with force at once, as the slot is
+// about to be reused. Caller must hold simple_detector.lock.
+static void
+flush_alert(struct alertsup *s, int rule, int sid, int force)
+{
+    uint now = ticks;
+    struct detect_alert alert;
+
+    if(s->count == 0 ||
+       (!force && ((int)(now - s->next) < 0 || !alert_token(now)))) {
+        return;
+    }
+    memset(&alert, 0, sizeof(alert));
+    alert.tick = now;
+    alert.kind = s->kind;
+    alert.pid = s->pid;
+    alert.sid = sid;
+    alert.rule = rule;
+    alert.op = -1;
+    alert.status = 1;
+    alert.count = s->count;
+    alert.span = s->last - s->first;
+    for(struct actor *a = simple_detector.actors; a < &simple_detector.actors[NPROC]; a++) {
+        if(a->pid == s->pid) {
+            safestrcpy(alert.proc_name, a->name, sizeof(alert.proc_name));
+            break;
+        }
+    }
+    alert_push(&alert);
+    s->count = 0;
+}
+
+// Find the session table slot of sid, taking over an unused or
+// idle slot for a session not seen before. Slots are never emptied
+// again, so a lookup probes until it finds sid or an unused slot.
+// Returns 0 if the table is full of active sessions.
+static struct session*
+find_session(int sid, uint now)
+{
+    struct session *free = 0;
+
+    for(int i = 0; i < NSESSIONS; i++) {
+        struct session *s = &simple_detector.sessions[(sid + i) % NSESSIONS];
+        if(s->sid == sid) {
+            return s;
+        }
+        if(s->sid == 0) {
+            if(free == 0) {
+                free = s;
+            }
+            break;
+        }
+        if(free == 0 && now - s->last > SESSION_IDLE) {
+            free = s;
+        }
+    }
+    if(free) {
+        for(int r = 0; r < MAX_RULES; r++) {
+            flush_alert(&free->sup[r], r, free->sid, 1);
+        }
+        memset(free, 0, sizeof(*free));
+        free->sid = sid;
+        free->last = now;
+    }
+    return free;
+}
+
+// Find the detector slot of the calling process, resetting it
+// if it was last used by a process that has since exited.
+static struct actor*
+current_actor(int pid)
+{
+    struct proc *p = myproc();
+    if(p == 0) {
+        return 0;
+    }
+
+    struct actor *a = &simple_detector.actors[p - proc];
+    if(a->pid != pid) {
+        acquire(&simple_detector.lock);
+        for(int i = 0; i < ALERT_SOURCES; i++) {
+            flush_alert(&a->sup[i], i < MAX_RULES ? i : -1,
+                        a->sess ? a->sess->sid : 0, 1);
+        }
+        memset(a, 0, sizeof(*a));
+        a->pid = pid;
+        release(&simple_detector.lock);
+    }
+    return a;
+}
+
+// Flush the pending firings whose backoff has run out, of every
+// process and session, at most once a second.
+// Caller must hold simple_detector.lock.
+static void
+flush_alerts(uint now)
+{
+    if(now - simple_detector.alert_flushed < TICKS_PER_SEC) {
+        return;
+    }
+    simple_detector.alert_flushed = now;
+    for(struct actor *a = simple_detector.actors; a < &simple_detector.actors[NPROC]; a++) {
+        if(a->pid == 0) {
+            continue;
+        }
+        for(int i = 0; i < ALERT_SOURCES; i++) {
+            flush_alert(&a->sup[i], i < MAX_RULES ? i : -1,
+                        a->sess ? a->sess->sid : 0, 0);
+        }
+    }
+    for(struct session *ss = simple_detector.sessions; ss < &simple_detector.sessions[NSESSIONS]; ss++) {
+        if(ss->sid == 0) {
+            continue;
+        }
+        for(int r = 0; r < MAX_RULES; r++) {
+            flush_alert(&ss->sup[r], r, ss->sid, 0);
+        }
+    }
+}
+
+// Queue an alert for actor a, or count it against the alert's
+// (process, source) slot while that slot is backing off. The
+// queued alert reports how many firings it stands for.
+// Caller must hold simple_detector.lock.
+static void
+raise_alert(struct actor *a, int kind, char *proc_name, int rule, uint rate,
+            int op, char *filename, int status, uint inum)
+{
+    uint now = ticks;
+    struct alertsup *s = &a->sup[MAX_RULES + kind];
+
+    // session-wide rules back off per session, not per process
+    if(kind == ALERT_RULE || kind == ALERT_DISTINCT) {
+        if(simple_detector.rt.rules[rule].scope == RULE_SCOPE_SESSION && a->sess) {
+            s = &a->sess->sup[rule];
+        } else {
+            s = &a->sup[rule];
+        }
+    }
+
+    if(s->count == 0) {
+        s->first = now;
+    }
+    s->count++;
+    s->last = now;
+    s->kind = kind;
+    s->pid = a->pid;
+    safestrcpy(a->name, proc_name, sizeof(a->name));
+    if((int)(now - s->next) < 0 || !alert_token(now)) {
+        return;
+    }
+
+    struct detect_alert alert;
+    alert.tick = now;
+    alert.kind = kind;
+    alert.pid = a->pid;
+    alert.ppid = parentpid(myproc());
+    alert.sid = myproc()->sid;
+    alert.inum = inum;
+    alert.rule = rule;
+    alert.rate = rate;
+    alert.op = op;
+    alert.status = status;
+    safestrcpy(alert.proc_name, proc_name, sizeof(alert.proc_name));
+    alert.count = s->count;
+    alert.span = now - s->first;
+    safestrcpy(alert.filename, filename, sizeof(alert.filename));
+    alert_push(&alert);
+
+    // keep doubling while the source fires again within its
+    // backoff, start over once it has been quiet that long
+    if(s->backoff == 0 || now - s->next >= s->backoff) {
+        s->backoff = ALERT_BACKOFF_MIN;
+    } else if(s->backoff < ALERT_BACKOFF_MAX) {
+        s->backoff *= 2;
+    }
+    s->next = now + s->backoff;
+    s->count = 0;
+}
+
+static struct recent_file*
+find_recent(struct ransom_state *rs, uint path)
+{
+    for(int i = 0; i < RANSOM_FILES; i++) {
+        if(rs->files[i].flags && rs->files[i].path == path) {
+            return &rs->files[i];
+        }
+    }
+    return 0;
+}
+
+// Advance the per-process ransomware state machine by one event.
+// A file read and then written is rewritten in place; a file read,
+// followed by a write to a sibling, and then deleted was replaced.
+// Builds write new files and delete files they wrote, so neither
+// pattern fires for them.
+static void
+track_ransomware(struct actor *a, int pid, char *proc_name, int op,
+                 char *filename, int status)
+{
+    struct ransom_state *rs = &a->ransom;
+    uint now = ticks;
+    uint dir;
+    uint path;
+
+    if(status == 0 || (op != OP_READ && op != OP_WRITE &&
+                       op != OP_CREATE && op != OP_DELETE)) {
+        return;
+    }
+
+    path = hash_path(filename, &dir);
+    struct recent_file *rf = find_recent(rs, path);
+
+    if(op == OP_DELETE) {
+        if(rf == 0 || rf->flags != RF_READ) {
+            return;
+        }
+        rf->flags = 0;
+        for(int i = 0; i < RANSOM_FILES; i++) {
+            struct recent_file *sib = &rs->files[i];
+            if((sib->flags & RF_WROTE) && sib->dir == dir &&
+               sib->path != path && sib->tick - rf->tick < RATE_SLOTS * 2) {
+                uint rate = ratewin_add(&rs->replaces, now);
+                if(rate >= RANSOM_REPLACE_RATE) {
+                    raise_alert(a, ALERT_RANSOM_REPLACE, proc_name, -1,
+                                rate, op, filename, status, 0);
+                }
+                break;
+            }
+        }
+        return;
+    }
+
+    if(rf == 0) {
+        rf = &rs->files[rs->next];
+        rs->next = (rs->next + 1) % RANSOM_FILES;
+        rf->path = path;
+        rf->dir = dir;
+        rf->flags = 0;
+    }
+    rf->tick = now;
+
+    if(op == OP_READ) {
+        rf->flags |= RF_READ;
+    } else if(!(rf->flags & RF_WROTE)) {
+        rf->flags |= RF_WROTE;
+        if(rf->flags & RF_READ) {
+            uint rate = ratewin_add(&rs->rewrites, now);
+            if(rate >= RANSOM_REWRITE_RATE) {
+                raise_alert(a, ALERT_RANSOM_REWRITE, proc_name, -1,
+                            rate, op, filename, status, 0);
+            }
+        }
+    }
+}
+
+// The baseline of proc_name, or 0. With create, make one, once
+// every slot is taken in place of the least recently sampled.
+static struct prog_baseline*
+find_baseline(char *proc_name, int create)
+{
+    struct prog_baseline *b;
+    uint *used = simple_detector.baseline_used;
+    int i, lru = 0;
+
+    for(i = 0; i < simple_detector.nbaselines; i++) {
+        b = &simple_detector.baselines[i];
+        if(strncmp(b->proc_name, proc_name, sizeof(b->proc_name)) == 0) {
+            used[i] = ticks;
+            return b;
+        }
+        if((int)(used[i] - used[lru]) < 0) {
+            lru = i;
+        }
+    }
+    if(!create) {
+        return 0;
+    }
+    if(simple_detector.nbaselines < MAX_BASELINES) {
+        i = simple_detector.nbaselines++;
+    } else {
+        i = lru;
+    }
+    used[i] = ticks;
+    b = &simple_detector.baselines[i];
+    memset(b, 0, sizeof(*b));
+    safestrcpy(b->proc_name, proc_name, sizeof(b->proc_name));
+    return b;
+}
+
+static uint
+popcount(uint x)
+{
+    uint n = 0;
+    for(; x; x &= x - 1) {
+        n++;
+    }
+    return n;
+}
+
+static uint
+saturate(uint x)
+{
+    return x > BL_MAX_SAMPLE ? BL_MAX_SAMPLE : x;
+}
+
+// Score a finished one-second sample against its program's
+// baseline, then fold it in. Only activity above the mean is
+// scored, and anomalous seconds are not learned. Caller must
+// hold simple_detector.lock.
+static void
+close_sample(struct actor *a, int pid, char *proc_name)
+{
+    struct blsample *s = &a->bl;
+    uint x[BL_NMETRICS];
+
+    if(s->ops == 0) {
+        return;
+    }
+    struct prog_baseline *b = find_baseline(proc_name, 1);
+    if(b == 0) {
+        return;
+    }
+
+    x[BL_OPS] = saturate(s->ops) << BL_FRAC;
+    x[BL_FAIL] = (saturate(s->fails) << BL_FRAC) / s->ops;
+    x[BL_FILES] = (popcount(s->files[0]) + popcount(s->files[1])) << BL_FRAC;
+    x[BL_BYTES] = saturate(s->bytes) << BL_FRAC;
+
+    if(b->samples == 0) {
+        memmove(b->mean, x, sizeof(x));
+        b->samples = 1;
+        return;
+    }
+
+    if(b->samples >= BL_MIN_SAMPLES) {
+        int worst = -1;
+        uint score = 0;
+        for(int m = 0; m < BL_NMETRICS; m++) {
+            if(x[m] <= b->mean[m]) {
+                continue;
+            }
+            // floor the deviation so a very steady program is not
+            // flagged for a change of one unit, or for the failure
+            // ratio, which is at most one, of a sixteenth
+            uint floor = m == BL_FAIL ? 1 << (BL_FRAC - 4) : 1 << BL_FRAC;
+            uint dev = b->dev[m] + (b->mean[m] >> 2) + floor;
+            uint z = (x[m] - b->mean[m]) / dev;
+            if(z > score) {
+                score = z;
+                worst = m;
+            }
+        }
+        if(score >= BL_SCORE) {
+            raise_alert(a, ALERT_ANOMALY, proc_name, worst, score, 0, "", 1, 0);
+            return;
+        }
+    }
+
+    for(int m = 0; m < BL_NMETRICS; m++) {
+        uint d = x[m] > b->mean[m] ? x[m] - b->mean[m] : b->mean[m] - x[m];
+        b->mean[m] = b->mean[m] - (b->mean[m] >> BL_SHIFT) + (x[m] >> BL_SHIFT);
+        b->dev[m] = b->dev[m] - (b->dev[m] >> BL_SHIFT) + (d >> BL_SHIFT);
+    }
+    b->samples++;
+}
+
+// Add one event to the process's current one-second sample,
+// closing the previous sample when a new second starts.
+// Caller must hold simple_detector.lock.
+static void
+track_baseline(struct actor *a, int pid, char *proc_name, char *filename,
+               int status, int bytes)
+{
+    struct blsample *s = &a->bl;
+    uint sec = ticks / TICKS_PER_SEC;
+    uint dir;
+
+    if(sec != s->sec) {
+        close_sample(a, pid, proc_name);
+        memset(s, 0, sizeof(*s));
+        s->sec = sec;
+    }
+
+    s->ops++;
+    if(status == 0) {
+        s->fails++;
+    }
+    if(bytes > 0) {
+        s->bytes += bytes;
+    }
+    if(filename[0]) {
+        uint bit = hash_path(filename, &dir) & 63;
+        s->files[bit >> 5] |= 1 << (bit & 31);
+    }
+}
+
+// Start or extend the throttle on the calling process
+static void
+throttle(struct actor *a, char *proc_name, int rule, uint rate, int op,
+         char *filename, int status)
+{
+    struct proc *p = myproc();
+    uint now = ticks;
+
+    if(p->throttle_until == 0) {
+        p->tokens = THROTTLE_BURST;
+        p->token_tick = now;
+        raise_alert(a, ALERT_THROTTLE, proc_name, rule, rate, op, filename, status, 0);
+    }
+    p->throttle_until = now + THROTTLE_TICKS;
+    if(p->throttle_until == 0) {
+        p->throttle_until = 1;
+    }
+}
+
+// Called at the top of the file syscalls. Free for unthrottled
+// processes; a throttled one sleeps until its bucket has a token.
+void
+file_throttle(void)
+{
+    struct proc *p = myproc();
+
+    if(p->throttle_until == 0) {
+        return;
+    }
+
+    acquire(&tickslock);
+    while(!killed(p)) {
+        if((int)(ticks - p->throttle_until) >= 0) {
+            p->throttle_until = 0;
+            break;
+        }
+        uint refill = (ticks - p->token_tick) * THROTTLE_RATE;
+        if(refill > 0) {
+            p->tokens += refill;
+            if(p->tokens > THROTTLE_BURST) {
+                p->tokens = THROTTLE_BURST;
+            }
+            p->token_tick = ticks;
+        }
+        if(p->tokens > 0) {
+            p->tokens--;
+            break;
+        }
+        sleep(&ticks, &tickslock);
+    }
+    release(&tickslock);
+}
+
 // Initialize detector
 void
 detector_init(void)
 {
-    simple_detector.failed_count = 0;
-    simple_detector.access_count = 0;
-    simple_detector.last_access_time = 0;
-    simple_detector.last_alert_time = 0;
+    initlock(&simple_detector.lock, "detector");
+    memset(&simple_detector.rt, 0, sizeof(simple_detector.rt));
+    memset(simple_detector.actors, 0, sizeof(simple_detector.actors));
+    memset(simple_detector.sessions, 0, sizeof(simple_detector.sessions));
+    simple_detector.alert_tokens = ALERT_BURST;
+    simple_detector.alert_refill = 0;
+    simple_detector.nbaselines = 0;
+
+    simple_detector.rt.nrules = NELEM(default_rules);
+    memmove(simple_detector.rt.rules, default_rules, sizeof(default_rules));
+    compile_rules(&simple_detector.rt);
+
+    alert_init();
 }
 
-// Simple detection function
+// Detection entry point, called for every file event
 void
-check_suspicious(int pid, char *proc_name, char *operation, char *filename, int status)
+check_suspicious(int pid, char *proc_name, int op, char *filename, int status,
+                 int bytes, int watch)
 {
-    // Skip system processes
-    if(strncmp(proc_name, "init", 4) == 0 || strncmp(proc_name, "showlogs", 8) == 0) {
+    struct actor *a = current_actor(pid);
+    if(a == 0 || op < 0 || op >= NOPS) {
         return;
     }
 
-    // Reset counters if time window passed
-    if(ticks - simple_detector.last_access_time > TIME_WINDOW) {
-        simple_detector.access_count = 0;
-        simple_detector.failed_count = 0;
-    }
+    struct ruletab *rt = &simple_detector.rt;
+    uint now = ticks;
 
-    simple_detector.last_access_time = ticks;
+    acquire(&simple_detector.lock);
+    flush_alerts(now);
 
-    if(status == 0) {  // Failed operation
-        simple_detector.failed_count++;
-        if(simple_detector.failed_count >= MAX_FAILED_ATTEMPTS) {
-            if(ticks - simple_detector.last_alert_time > TIME_WINDOW) {
-                printf("ALERT: PID %d (%s) has %d failed attempts\n", 
-                       pid, proc_name, simple_detector.failed_count);
-                simple_detector.last_alert_time = ticks;
+    // every event counts toward the process's and the session's
+    // activity, whatever the rules say
+    int sid = myproc()->sid;
+    if(sid <= 0) {
+        a->sess = 0;
+    } else if(a->sess == 0 || a->sess->sid != sid) {
+        a->sess = find_session(sid, now);
+    }
+    struct session *ss = a->sess;
+    uint dir;
+    uint path = filename[0] ? hash_path(filename, &dir) : 0;
+    if(filename[0]) {
+        hll_rotate(&a->files, now);
+        hll_add(&a->files, path);
+    }
+    if(ss) {
+        ss->last = now;
+        ss->events++;
+        if(status == 0) {
+            ss->failures++;
+        }
+        ratewin_add(&ss->ops, now);
+        if(filename[0]) {
+            hll_rotate(&ss->files, now);
+            hll_add(&ss->files, path);
+        }
+        if(ss->gen != rt->gen) {
+            for(int r = 0; r < MAX_RULES; r++) {
+                flush_alert(&ss->sup[r], r, ss->sid, 1);
             }
+            memset(ss->win, 0, sizeof(ss->win));
+            memset(ss->sup, 0, sizeof(ss->sup));
+            ss->gen = rt->gen;
         }
-    } else {  // Successful operation
-        simple_detector.access_count++;
-        if(simple_detector.access_count >= MAX_RAPID_ACCESS) {
-            if(ticks - simple_detector.last_alert_time > TIME_WINDOW) {
-                printf("ALERT: PID %d (%s) accessing files rapidly (%d ops)\n", 
-                       pid, proc_name, simple_detector.access_count);
-                simple_detector.last_alert_time = ticks;
+    }
+
+    uint match = rt->opst[op][status != 0];
+    if(match) {
+        match &= rt->any_proc | lookup_proc(rt, proc_name);
+    }
+    if(match) {
+        match &= rt->any_prefix | lookup_prefix(rt, filename);
+    }
+    if(match & rt->ignore) {
+        release(&simple_detector.lock);
+        return;
+    }
+
+    if(watch & WL_ALERT) {
+        raise_alert(a, ALERT_WATCHLIST, proc_name, -1, 0, op, filename, status, 0);
+    }
+
+    if(a->gen != rt->gen) {
+        // rules were reloaded, old windows belong to other rules
+        for(int r = 0; r < MAX_RULES; r++) {
+            flush_alert(&a->sup[r], r, sid, 1);
+        }
+        memset(a->win, 0, sizeof(a->win));
+        memset(a->sup, 0, MAX_RULES * sizeof(a->sup[0]));
+        a->gen = rt->gen;
+    }
+
+    // Only the matched rules are visited, at most MAX_RULES
+    int distinct[2] = { -1, -1 };   // per process, per session
+    for(int r = 0; match; r++, match >>= 1) {
+        if(!(match & 1)) {
+            continue;
+        }
+        struct detect_rule *rule = &rt->rules[r];
+        int session = rule->scope == RULE_SCOPE_SESSION;
+        if(session && ss == 0) {
+            continue;
+        }
+        if(rule->metric == RULE_M_FILES) {
+            struct hll *h = session ? &ss->files : &a->files;
+            if(distinct[session] < 0) {
+                distinct[session] = hll_estimate(h->cur, h->prev);
+            }
+            if(distinct[session] >= rule->rate) {
+                raise_alert(a, ALERT_DISTINCT, proc_name, r, distinct[session],
+                            op, filename, status, 0);
+                if(rule->action == RULE_ACT_THROTTLE) {
+                    throttle(a, proc_name, r, distinct[session], op, filename,
+                             status);
+                }
             }
+            continue;
+        }
+        uint rate = ratewin_add(session ? &ss->win[r] : &a->win[r], now);
+        if(rate < rule->rate) {
+            continue;
         }
+        raise_alert(a, ALERT_RULE, proc_name, r, rate, op, filename, status, 0);
+        if(rule->action == RULE_ACT_THROTTLE) {
+            throttle(a, proc_name, r, rate, op, filename, status);
+        }
+    }
+
+    track_ransomware(a, pid, proc_name, op, filename, status);
+    track_baseline(a, pid, proc_name, filename, status, bytes);
+
+    release(&simple_detector.lock);
+}
+
+// Track a successful read of n bytes at off from a watched or
+// audited file of the given size, and alert once a single
+// contiguous run has covered the file from start to end.
+void
+check_sequential(int pid, char *proc_name, char *filename, uint inum,
+                 uint off, uint n, uint size)
+{
+    struct actor *a = current_actor(pid);
+    if(a == 0 || n == 0) {
+        return;
     }
-}
\ No newline at end of file
+
+    uint now = ticks;
+    struct seqread *s = 0;
+    struct seqread *victim = &a->seq[0];
+    for(int i = 0; i < SEQ_FILES; i++) {
+        if(a->seq[i].inum == inum) {
+            s = &a->seq[i];
+            break;
+        }
+        if(a->seq[i].inum == 0 ||
+           (victim->inum && now - a->seq[i].tick > now - victim->tick)) {
+            victim = &a->seq[i];
+        }
+    }
+    if(s == 0) {
+        s = victim;
+        s->inum = inum;
+        s->start = off;
+        s->next = off;
+    }
+
+    // a seek or a re-read starts a new run
+    if(off != s->next) {
+        s->start = off;
+    }
+    s->next = off + n;
+    s->tick = now;
+
+    if(s->start == 0 && s->next >= size) {
+        acquire(&simple_detector.lock);
+        raise_alert(a, ALERT_SEQ_READ, proc_name, -1, size, OP_READ,
+                    filename, 1, inum);
+        release(&simple_detector.lock);
+        s->inum = 0;
+    }
+}
+
+// Replace the rule table with n rules copied from user space.
+// n < 0 restores the built-in rules.
+int
+set_detect_rules(uint64 user_rules, int n)
+{
+    if(n > MAX_RULES) {
+        return -1;
+    }
+
+    // Copy into a scratch page first, copyin may not run under the lock
+    struct detect_rule *tmp = (struct detect_rule*)kalloc();
+    if(tmp == 0) {
+        return -1;
+    }
+    if(n < 0) {
+        n = NELEM(default_rules);
+        memmove(tmp, default_rules, sizeof(default_rules));
+    } else if(n > 0 && copyin(myproc()->pagetable, (char*)tmp, user_rules,
+                              n * sizeof(struct detect_rule)) < 0) {
+        kfree(tmp);
+        return -1;
+    }
+
+    acquire(&simple_detector.lock);
+    memmove(simple_detector.rt.rules, tmp, n * sizeof(struct detect_rule));
+    simple_detector.rt.nrules = n;
+    compile_rules(&simple_detector.rt);
+    release(&simple_detector.lock);
+
+    kfree(tmp);
+    return n;
+}
+
+// Copy the active rules to user space, returns the number copied
+int
+get_detect_rules(uint64 user_rules, int max)
+{
+    struct detect_rule *tmp = (struct detect_rule*)kalloc();
+    if(tmp == 0) {
+        return -1;
+    }
+
+    acquire(&simple_detector.lock);
+    int n = simple_detector.rt.nrules;
+    memmove(tmp, simple_detector.rt.rules, n * sizeof(struct detect_rule));
+    release(&simple_detector.lock);
+
+    if(n > max) {
+        n = max < 0 ? 0 : max;
+    }
+    if(n > 0 && copyout(myproc()->pagetable, user_rules, (char*)tmp,
+                        n * sizeof(struct detect_rule)) < 0) {
+        n = -1;
+    }
+    kfree(tmp);
+    return n;
+}
+
+// Replace the learned baselines with n copied from user space.
+// n = 0 forgets all of them.
+int
+set_baselines(uint64 user_baselines, int n)
+{
+    if(n < 0 || n > MAX_BASELINES) {
+        return -1;
+    }
+
+    struct prog_baseline *tmp = (struct prog_baseline*)kalloc();
+    if(tmp == 0) {
+        return -1;
+    }
+    if(n > 0 && copyin(myproc()->pagetable, (char*)tmp, user_baselines,
+                       n * sizeof(struct prog_baseline)) < 0) {
+        kfree(tmp);
+        return -1;
+    }
+    for(int i = 0; i < n; i++) {
+        tmp[i].proc_name[sizeof(tmp[i].proc_name) - 1] = 0;
+    }
+
+    acquire(&simple_detector.lock);
+    memmove(simple_detector.baselines, tmp, n * sizeof(struct prog_baseline));
+    for(int i = 0; i < n; i++) {
+        simple_detector.baseline_used[i] = ticks;
+    }
+    simple_detector.nbaselines = n;
+    release(&simple_detector.lock);
+
+    kfree(tmp);
+    return n;
+}
+
+// Copy the learned baselines to user space, returns the number copied
+int
+get_baselines(uint64 user_baselines, int max)
+{
+    struct prog_baseline *tmp = (struct prog_baseline*)kalloc();
+    if(tmp == 0) {
+        return -1;
+    }
+
+    acquire(&simple_detector.lock);
+    int n = simple_detector.nbaselines;
+    memmove(tmp, simple_detector.baselines, n * sizeof(struct prog_baseline));
+    release(&simple_detector.lock);
+
+    if(n > max) {
+        n = max < 0 ? 0 : max;
+    }
+    if(n > 0 && copyout(myproc()->pagetable, user_baselines, (char*)tmp,
+                        n * sizeof(struct prog_baseline)) < 0) {
+        n = -1;
+    }
+    kfree(tmp);
+    return n;
+}
+
+// Estimate how many distinct files process pid touched recently
+int
+get_file_cardinality(int pid, uint64 user_card)
+{
+    struct file_cardinality card;
+    struct hll h;
+    int found = 0;
+
+    acquire(&simple_detector.lock);
+    for(int i = 0; i < NPROC; i++) {
+        struct actor *a = &simple_detector.actors[i];
+        if(a->pid == pid && proc[i].pid == pid) {
+            hll_rotate(&a->files, ticks);
+            h = a->files;
+            found = 1;
+            break;
+        }
+    }
+    release(&simple_detector.lock);
+
+    if(!found) {
+        return -1;
+    }
+    card.current = hll_estimate(h.cur, 0);
+    card.previous = hll_estimate(h.prev, 0);
+    card.recent = hll_estimate(h.cur, h.prev);
+    card.window = HLL_WINDOW;
+    if(copyout(myproc()->pagetable, user_card, (char*)&card, sizeof(card)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Report the activity of session sid
+int
+get_session_stats(int sid, uint64 user_stats)
+{
+    struct session_stats st;
+    struct session *s = 0;
+    uint now = ticks;
+
+    if(sid <= 0) {
+        return -1;
+    }
+
+    acquire(&simple_detector.lock);
+    for(int i = 0; i < NSESSIONS; i++) {
+        struct session *t = &simple_detector.sessions[(sid + i) % NSESSIONS];
+        if(t->sid == sid || t->sid == 0) {
+            s = t->sid == sid ? t : 0;
+            break;
+        }
+    }
+    if(s == 0) {
+        release(&simple_detector.lock);
+        return -1;
+    }
+    st.sid = sid;
+    st.events = s->events;
+    st.failures = s->failures;
+    ratewin_advance(&s->ops, now);
+    st.rate = s->ops.total;
+    hll_rotate(&s->files, now);
+    st.distinct = hll_estimate(s->files.cur, s->files.prev);
+    release(&simple_detector.lock);
+
+    // a racy count is fine, it is only a report
+    st.procs = 0;
+    for(int i = 0; i < NPROC; i++) {
+        if(proc[i].state != UNUSED && proc[i].sid == sid) {
+            st.procs++;
+        }
+    }
+
+    if(copyout(myproc()->pagetable, user_stats, (char*)&st, sizeof(st)) < 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -6,6 +6,9 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -107,6 +110,29 @@ extern uint64 sys_clear_logs(void);
 extern uint64 sys_get_history_logs(void);
 extern uint64 sys_get_history_stats(void);
 extern uint64 sys_clear_history_logs(void);
+extern uint64 sys_set_detect_rules(void);
+extern uint64 sys_get_detect_rules(void);
+extern uint64 sys_wait_alerts(void);
+extern uint64 sys_get_alert_stats(void);
+extern uint64 sys_set_alert_console(void);
+extern uint64 sys_set_watchlist(void);
+extern uint64 sys_get_watchlist(void);
+extern uint64 sys_set_audit(void);
+extern uint64 sys_set_baselines(void);
+extern uint64 sys_get_baselines(void);
+extern uint64 sys_get_file_cardinality(void);
+extern uint64 sys_setsid(void);
+extern uint64 sys_get_session_stats(void);
+extern uint64 sys_time(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_snapshot(void);
+extern uint64 sys_syscall_audit(void);
+extern uint64 sys_fim(void);
+extern uint64 sys_set_log_key(void);
+extern uint64 sys_get_history_chunk(void);
+extern uint64 sys_watch(void);
+extern uint64 sys_set_log_policy(void);
+extern uint64 sys_get_log_policy(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -138,8 +164,141 @@ static uint64 (*syscalls[])(void) = {
 [SYS_get_history_logs] sys_get_history_logs,
 [SYS_get_history_stats] sys_get_history_stats,
 [SYS_clear_history_logs] sys_clear_history_logs,
+[SYS_set_detect_rules] sys_set_detect_rules,
+[SYS_get_detect_rules] sys_get_detect_rules,
+[SYS_wait_alerts] sys_wait_alerts,
+[SYS_get_alert_stats] sys_get_alert_stats,
+[SYS_set_alert_console] sys_set_alert_console,
+[SYS_set_watchlist] sys_set_watchlist,
+[SYS_get_watchlist] sys_get_watchlist,
+[SYS_set_audit] sys_set_audit,
+[SYS_set_baselines] sys_set_baselines,
+[SYS_get_baselines] sys_get_baselines,
+[SYS_get_file_cardinality] sys_get_file_cardinality,
+[SYS_setsid] sys_setsid,
+[SYS_get_session_stats] sys_get_session_stats,
+[SYS_time] sys_time,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_snapshot] sys_snapshot,
+[SYS_syscall_audit] sys_syscall_audit,
+[SYS_fim]     sys_fim,
+[SYS_set_log_key] sys_set_log_key,
+[SYS_get_history_chunk] sys_get_history_chunk,
+[SYS_watch]   sys_watch,
+[SYS_set_log_policy] sys_set_log_policy,
+[SYS_get_log_policy] sys_get_log_policy,
 };
 
+// Syscall audit hook. The syscalls below have no hand-placed
+// log_file_access() calls in their handlers; syscall() logs them
+// when they return, if their bit is set in audit_mask. Each names
+// what it acts on with an extractor run before the call, since
+// the call may clobber its arguments (exec replaces them all).
+
+// argument n is a path; longer paths are cut short
+static void
+audit_path(int n, char *target, int max)
+{
+  uint64 addr;
+
+  argaddr(n, &addr);
+  target[0] = 0;
+  if(fetchstr(addr, target, max) < 0)
+    target[max-1] = 0;
+}
+
+static void
+audit_arg0(char *target)
+{
+  audit_path(0, target, FILENAME_MAX);
+}
+
+// "old -> new"
+static void
+audit_link(char *target)
+{
+  audit_path(0, target, FILENAME_MAX);
+  int n = strlen(target);
+  if(n + 5 <= FILENAME_MAX){
+    safestrcpy(target + n, " -> ", FILENAME_MAX - n);
+    audit_path(1, target + n + 4, FILENAME_MAX - n - 4);
+  }
+}
+
+// argument 0 is a file descriptor
+static void
+audit_fd(char *target)
+{
+  int fd;
+  struct file *f;
+
+  argint(0, &fd);
+  target[0] = 0;
+  if(fd >= 0 && fd < NOFILE && (f = myproc()->ofile[fd]) != 0)
+    safestrcpy(target, f->path, FILENAME_MAX);
+}
+
+static struct {
+  char *op;                    // operation name logged
+  void (*target)(char*);       // fills in the logged filename, or 0
+  void (*log)(char*, int);     // logs the call itself, 0 for the default
+} auditcalls[] = {
+[SYS_fork]  { "FORK",  0 },
+[SYS_pipe]  { "PIPE",  0 },
+[SYS_exec]  { "EXEC",  audit_arg0, log_exec },
+[SYS_dup]   { "DUP",   audit_fd },
+[SYS_mknod] { "MKNOD", audit_arg0 },
+[SYS_link]  { "LINK",  audit_link },
+[SYS_mkdir] { "MKDIR", audit_arg0 },
+};
+
+static uint64 audit_mask = (1L << SYS_exec) | (1L << SYS_link) |
+  (1L << SYS_mkdir) | (1L << SYS_mknod) | (1L << SYS_dup) |
+  (1L << SYS_pipe) | (1L << SYS_fork);
+
+// append x in hex to s
+static char*
+audit_hex(char *s, uint64 x)
+{
+  static char digits[] = "0123456789abcdef";
+  char buf[16];
+  int i = 0;
+
+  do {
+    buf[i++] = digits[x % 16];
+  } while((x /= 16) != 0);
+  *s++ = '0';
+  *s++ = 'x';
+  while(--i >= 0)
+    *s++ = buf[i];
+  *s = 0;
+  return s;
+}
+
+// Set then clear bits of audit_mask, ignoring syscalls the hook
+// does not cover. Returns the new mask. A change is logged, past
+// the log filters, as an AUDIT record naming the caller and the
+// old and new masks, "0x... -> 0x...".
+uint64
+syscall_audit(uint64 enable, uint64 disable)
+{
+  struct proc *p = myproc();
+  uint64 covered = 0, old = audit_mask;
+  char target[FILENAME_MAX];
+
+  for(int i = 0; i < NELEM(auditcalls); i++)
+    if(auditcalls[i].op)
+      covered |= 1L << i;
+  audit_mask = (audit_mask | (enable & covered)) & ~disable;
+  if(audit_mask != old){
+    char *s = audit_hex(target, old);
+    safestrcpy(s, " -> ", 5);
+    audit_hex(s + 4, audit_mask);
+    log_file_access(p->pid, p->name, "AUDIT", target, 0, 1, IA_AUDIT, -1);
+  }
+  return audit_mask;
+}
+
 void
 syscall(void)
 {
@@ -148,9 +307,23 @@ syscall(void)
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    char target[FILENAME_MAX];
+    int audit = (audit_mask >> num) & 1;
+
+    if(audit && auditcalls[num].target)
+      auditcalls[num].target(target);
+    else
+      target[0] = 0;
+
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
     p->trapframe->a0 = syscalls[num]();
+
+    if(audit && auditcalls[num].log)
+      auditcalls[num].log(target, (int)p->trapframe->a0 >= 0);
+    else if(audit)
+      log_file_access(p->pid, p->name, auditcalls[num].op, target, 0,
+                      (int)p->trapframe->a0 >= 0, 0, -1);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
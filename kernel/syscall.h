@@ -25,4 +25,27 @@
 #define SYS_clear_logs 24
 #define SYS_get_history_logs 25
 #define SYS_get_history_stats 26
-#define SYS_clear_history_logs 27
\ No newline at end of file
+#define SYS_clear_history_logs 27
+#define SYS_set_detect_rules 28
+#define SYS_get_detect_rules 29
+#define SYS_wait_alerts 30
+#define SYS_get_alert_stats 31
+#define SYS_set_alert_console 32
+#define SYS_set_watchlist 33
+#define SYS_get_watchlist 34
+#define SYS_set_audit 35
+#define SYS_set_baselines 36
+#define SYS_get_baselines 37
+#define SYS_get_file_cardinality 38
+#define SYS_setsid 39
+#define SYS_get_session_stats 40
+#define SYS_time 41
+#define SYS_clock_gettime 42
+#define SYS_snapshot 43
+#define SYS_syscall_audit 44
+#define SYS_fim 45
+#define SYS_set_log_key 46
+#define SYS_get_history_chunk 47
+#define SYS_watch 48
+#define SYS_set_log_policy 49
+#define SYS_get_log_policy 50
\ No newline at end of file
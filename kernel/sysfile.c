@@ -51,6 +51,25 @@ fdalloc(struct file *f)
   return -1;
 }
 
+// Offset the next read or write of f starts at, -1 if f has none.
+static int
+fileoff(struct file *f)
+{
+  if(f->type == FD_INODE)
+    return f->off;
+  return -1;
+}
+
+// Audit flags of the inode behind f; a single bit test
+// decides whether the access is audited.
+static int
+fileaudit(struct file *f)
+{
+  if(f->type == FD_INODE || f->type == FD_DEVICE)
+    return f->ip->audit;
+  return 0;
+}
+
 uint64
 sys_dup(void)
 {
@@ -72,24 +91,37 @@ sys_read(void)
   int n;
   uint64 p;
   struct proc *proc = myproc();
+  int watch;
 
   argaddr(1, &p);
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
   if(!f->readable){
-    log_file_access(proc->pid, proc->name, "READ", f->path, -1, 0);
+    log_file_access(proc->pid, proc->name, "READ", f->path, -1, 0, fileaudit(f), fileoff(f));
     return -1 ;
   }
+  // Reads of the audit log are not logged: each one would
+  // append a record for the next read to return. Nor are reads
+  // of a watch, which are not reads of the watched file.
+  if((f->type == FD_DEVICE && f->major == AUDITLOG) || f->type == FD_WATCH)
+    return fileread(f, p, n);
+
+  int off = fileoff(f);
   int result = fileread(f, p, n);
 
   // Simple logging call - let filelog.c handle the filtering
   if(result >= 0) {
-    log_file_access(proc->pid, proc->name, "READ", f->path, result, 1);
+    watch = log_file_access(proc->pid, proc->name, "READ", f->path, result, 1, fileaudit(f), off);
   }
   else {
-    log_file_access(proc->pid, proc->name, "READ", f->path, result, 0);
+    watch = log_file_access(proc->pid, proc->name, "READ", f->path, result, 0, fileaudit(f), off);
   }
+
+  // Watch for watched or audited files being read start to end.
+  // ip->size is only a hint here, so it is read without the lock.
+  if(result > 0 && off >= 0 && (watch || (fileaudit(f) & IA_AUDIT)))
+    check_sequential(proc->pid, proc->name, f->path, f->ip->inum, off, result, f->ip->size);
   return result;
 }
 
@@ -101,23 +133,27 @@ sys_write(void)
   uint64 p;
   struct proc *proc = myproc();
   
+  file_throttle();
   argaddr(1, &p);
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
   if(!f->writable){
-    log_file_access(proc->pid, proc->name, "WRITE", f->path, -1, 0);
+    log_file_access(proc->pid, proc->name, "WRITE", f->path, -1, 0, fileaudit(f), fileoff(f));
     return -1 ;
   }
 
+  int off = fileoff(f);
   int result = filewrite(f, p, n);
+  if(result > 0 && f->type == FD_INODE && f->ip->watches)
+    iwatch_event(f->ip, IW_WRITE);
   
   // Simple logging call - let filelog.c handle the filtering
   if(result >= 0) {
-    log_file_access(proc->pid, proc->name, "WRITE", f->path, result, 1);
+    log_file_access(proc->pid, proc->name, "WRITE", f->path, result, 1, fileaudit(f), off);
   }
   else {
-    log_file_access(proc->pid, proc->name, "WRITE", f->path, result, 0);
+    log_file_access(proc->pid, proc->name, "WRITE", f->path, result, 0, fileaudit(f), off);
   }
   return result;
 }
@@ -130,12 +166,12 @@ sys_close(void)
   struct proc *proc = myproc();
 
   if(argfd(0, &fd, &f) < 0){
-  log_file_access(proc->pid, proc->name, "CLOSE", "", -1, 0);
+  log_file_access(proc->pid, proc->name, "CLOSE", "", -1, 0, 0, -1);
     return -1;
   }
   
   // Simple logging call
-  log_file_access(proc->pid, proc->name, "CLOSE", f->path, 0, 1);
+  log_file_access(proc->pid, proc->name, "CLOSE", f->path, 0, 1, fileaudit(f), -1);
 
   myproc()->ofile[fd] = 0;
   fileclose(f);
@@ -227,17 +263,19 @@ sys_unlink(void)
   struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
+  int audit;
   struct proc *proc = myproc();
 
+  file_throttle();
   if(argstr(0, path, MAXPATH) < 0){
-    log_file_access(proc->pid, proc->name, "DELETE", path, -1, 0);
+    log_file_access(proc->pid, proc->name, "DELETE", path, -1, 0, 0, -1);
     return -1;
   }
 
   begin_op();
   if((dp = nameiparent(path, name)) == 0){
     end_op();
-    log_file_access(proc->pid, proc->name, "DELETE", path, -1, 0);
+    log_file_access(proc->pid, proc->name, "DELETE", path, -1, 0, 0, -1);
     return -1;
   }
 
@@ -254,6 +292,9 @@ sys_unlink(void)
     return -1 ;
   }
   ilock(ip);
+  audit = ip->audit;
+  if(audit & IA_CANARY)
+    canary_alert(OP_DELETE, path, ip->inum);
 
   if(ip->nlink < 1)
     panic("unlink: nlink < 1");
@@ -261,8 +302,8 @@ sys_unlink(void)
     iunlockput(ip);
     iunlockput(dp);
     end_op();
-    log_file_access(proc->pid, proc->name, "DELETE", path, -1, 0);
-    goto bad;
+    log_file_access(proc->pid, proc->name, "DELETE", path, -1, 0, audit, -1);
+    return -1;
   }
 
   memset(&de, 0, sizeof(de));
@@ -276,12 +317,14 @@ sys_unlink(void)
 
   ip->nlink--;
   iupdate(ip);
+  if(ip->watches)
+    iwatch_event(ip, IW_DELETE);
   iunlockput(ip);
 
   end_op();
 
   // Simple logging call
-  log_file_access(proc->pid, proc->name, "DELETE", path, 0, 1);
+  log_file_access(proc->pid, proc->name, "DELETE", path, 0, 1, audit, -1);
 
   return 0;
 
@@ -358,8 +401,11 @@ sys_open(void)
   struct file *f;
   struct inode *ip;
   int n;
+  int audit = 0;
+  int created = 0;
   struct proc *p = myproc();
 
+  file_throttle();
   argint(1, &omode);
   if((n = argstr(0, path, MAXPATH)) < 0)
     return -1;
@@ -370,22 +416,29 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      log_file_access(p->pid, p->name, "OPEN", path, -1, 0);
+      log_file_access(p->pid, p->name, "OPEN", path, -1, 0, 0, -1);
       return -1;
     }
-    // Always log creation
-    log_file_access(p->pid, p->name, "CREATE", path, 0, 1);
+    audit = ip->audit;
+    if(audit & IA_CANARY)
+      canary_alert(OP_OPEN, path, ip->inum);
+    // Always log creation, once ip is unlocked and the transaction
+    // over: logging may wait under LOG_BLOCK
+    created = 1;
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      log_file_access(p->pid, p->name, "OPEN", path, -1, 0);
+      log_file_access(p->pid, p->name, "OPEN", path, -1, 0, 0, -1);
       return -1;
     }
     ilock(ip);
+    audit = ip->audit;
+    if(audit & IA_CANARY)
+      canary_alert(OP_OPEN, path, ip->inum);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
-      log_file_access(p->pid, p->name, "OPEN", path, -1, 0);
+      log_file_access(p->pid, p->name, "OPEN", path, -1, 0, audit, -1);
       return -1;
     }
   }
@@ -393,7 +446,9 @@ sys_open(void)
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op();
-    log_file_access(p->pid, p->name, "OPEN", path, -1, 0);
+    if(created)
+      log_file_access(p->pid, p->name, "CREATE", path, 0, 1, audit, -1);
+    log_file_access(p->pid, p->name, "OPEN", path, -1, 0, audit, -1);
     return -1;
   }
 
@@ -402,7 +457,9 @@ sys_open(void)
       fileclose(f);
     iunlockput(ip);
     end_op();
-    log_file_access(p->pid, p->name, "OPEN", path, -1, 0);
+    if(created)
+      log_file_access(p->pid, p->name, "CREATE", path, 0, 1, audit, -1);
+    log_file_access(p->pid, p->name, "OPEN", path, -1, 0, audit, -1);
     return -1;
   }
 
@@ -411,8 +468,8 @@ sys_open(void)
     f->major = ip->major;
   } else {
     f->type = FD_INODE;
-    f->off = 0;
   }
+  f->off = 0;
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
@@ -423,12 +480,16 @@ sys_open(void)
     itrunc(ip);
   }
 
+  if(ip->watches)
+    iwatch_event(ip, IW_OPEN);
   iunlock(ip);
   end_op();
 
   // Log open operation (skip if already logged as CREATE)
-  if(!(omode & O_CREATE)) {
-    log_file_access(p->pid, p->name, "OPEN", path, 0, 1);
+  if(created) {
+    log_file_access(p->pid, p->name, "CREATE", path, 0, 1, audit, -1);
+  } else {
+    log_file_access(p->pid, p->name, "OPEN", path, 0, 1, audit, -1);
   }
 
   return fd;
@@ -475,25 +536,27 @@ sys_chdir(void)
 {
   char path[MAXPATH];
   struct inode *ip;
+  int audit;
   struct proc *p = myproc();
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
     end_op();
-    log_file_access(p->pid, p->name, "CHDIR", path, -1, 0);
+    log_file_access(p->pid, p->name, "CHDIR", path, -1, 0, 0, -1);
     return -1;
   }
   ilock(ip);
+  audit = ip->audit;
   if(ip->type != T_DIR){
     iunlockput(ip);
     end_op();
-    log_file_access(p->pid, p->name, "CHDIR", path, -1, 0);
+    log_file_access(p->pid, p->name, "CHDIR", path, -1, 0, audit, -1);
     return -1;
   }
   iunlock(ip);
   iput(p->cwd);
   end_op();
-  log_file_access(p->pid, p->name, "CHDIR", path, 0, 1);
+  log_file_access(p->pid, p->name, "CHDIR", path, 0, 1, audit, -1);
   p->cwd = ip;
   return 0;
 }
@@ -570,3 +633,120 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// Set the audit flags (IA_AUDIT, IA_CANARY) of the inode at path.
+// They live in the inode, so every link to it is covered.
+// flags < 0 only reads them. Returns the previous flags.
+uint64
+sys_set_audit(void)
+{
+  char path[MAXPATH];
+  struct inode *ip;
+  int flags, old;
+
+  argint(1, &flags);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  old = ip->audit;
+  if(flags >= 0){
+    // a tree kept across IA_FIM going off would miss the writes
+    // made meanwhile
+    if((old ^ flags) & IA_FIM)
+      fim_forget(ip);
+    ip->audit = flags;
+    iupdate(ip);
+  }
+  iunlockput(ip);
+  end_op();
+
+  return old;
+}
+
+// file integrity: run a FIM_* operation on an IA_FIM file,
+// copying the root hash in or out through the third argument.
+uint64
+sys_fim(void)
+{
+  char path[MAXPATH];
+  struct inode *ip;
+  uint64 addr, root;
+  int op, r;
+
+  argint(1, &op);
+  argaddr(2, &addr);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  if(op == FIM_LOAD && copyin(myproc()->pagetable, (char*)&root, addr, sizeof(root)) < 0)
+    return -1;
+
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  r = fim(ip, op, &root);
+  iunlockput(ip);
+  end_op();
+
+  if(r >= 0 && op != FIM_LOAD &&
+     copyout(myproc()->pagetable, addr, (char*)&root, sizeof(root)) < 0)
+    return -1;
+  return r;
+}
+
+// watch the inode at path for the IW_* events in mask,
+// returning a descriptor that reads struct iwatch_events.
+uint64
+sys_watch(void)
+{
+  char path[MAXPATH];
+  struct inode *ip;
+  struct file *f;
+  struct iwatch *w;
+  int fd, mask;
+
+  argint(1, &mask);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  if(mask == 0 || (mask & ~IW_ALL))
+    return -1;
+
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  end_op();
+
+  // the watch keeps namei()'s reference to ip
+  if((w = iwatch_alloc(ip, mask)) == 0)
+    goto bad;
+  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+    if(f)
+      fileclose(f);
+    iwatch_close(w);
+    goto bad;
+  }
+  f->type = FD_WATCH;
+  f->watch = w;
+  f->ip = ip;
+  f->off = 0;
+  f->readable = 1;
+  f->writable = 0;
+  safestrcpy(f->path, path, sizeof(f->path));
+  return fd;
+
+bad:
+  begin_op();
+  iput(ip);
+  end_op();
+  return -1;
+}
@@ -5,6 +5,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "timeutil.h"
 
 uint64
 sys_exit(void)
@@ -21,6 +22,14 @@ sys_getpid(void)
   return myproc()->pid;
 }
 
+// Make the calling process the root of a new session, whose
+// descendants the detector aggregates together
+uint64
+sys_setsid(void)
+{
+  return setsid();
+}
+
 uint64
 sys_fork(void)
 {
@@ -92,6 +101,53 @@ sys_uptime(void)
   return xticks;
 }
 
+// return the current time in seconds since 1970-01-01.
+uint64
+sys_time(void)
+{
+  return current_time();
+}
+
+// fill in the caller's struct timespec with the current time,
+// to the nanosecond.
+uint64
+sys_clock_gettime(void)
+{
+  uint64 addr;
+  struct timespec ts;
+
+  argaddr(0, &addr);
+  clock_now(&ts);
+  if(copyout(myproc()->pagetable, addr, (char*)&ts, sizeof(ts)) < 0)
+    return -1;
+  return 0;
+}
+
+// fill a set of log sections described by the caller
+// in one consistent pass.
+uint64
+sys_snapshot(void)
+{
+  uint64 secs;
+  int n;
+
+  argaddr(0, &secs);
+  argint(1, &n);
+  return snapshot(secs, n);
+}
+
+// set and clear bits of the syscall audit mask,
+// returning the new mask.
+uint64
+sys_syscall_audit(void)
+{
+  uint64 enable, disable;
+
+  argaddr(0, &enable);
+  argaddr(1, &disable);
+  return syscall_audit(enable, disable);
+}
+
 uint64
 sys_get_file_logs(void)
 {
@@ -158,6 +214,185 @@ sys_get_history_stats(void)
 uint64
 sys_clear_history_logs(void)
 {
-  clear_history_logs();
+  return clear_history_logs();
+}
+
+// set the history chain key, which can be done once.
+uint64
+sys_set_log_key(void)
+{
+  uint64 addr, key[2];
+
+  argaddr(0, &addr);
+  if(copyin(myproc()->pagetable, (char*)key, addr, sizeof(key)) < 0)
+    return -1;
+  return set_log_key(key[0], key[1]);
+}
+
+// copy out a sealed history chunk and its records.
+uint64
+sys_get_history_chunk(void)
+{
+  int index;
+  uint64 meta, logs;
+
+  argint(0, &index);
+  argaddr(1, &meta);
+  argaddr(2, &logs);
+  return get_history_chunk(index, meta, logs);
+}
+
+uint64
+sys_set_detect_rules(void)
+{
+  uint64 user_rules;
+  int n;
+
+  argaddr(0, &user_rules);
+  argint(1, &n);
+
+  return set_detect_rules(user_rules, n);
+}
+
+uint64
+sys_get_detect_rules(void)
+{
+  uint64 user_rules;
+  int max;
+
+  argaddr(0, &user_rules);
+  argint(1, &max);
+
+  return get_detect_rules(user_rules, max);
+}
+
+uint64
+sys_wait_alerts(void)
+{
+  uint64 user_buf;
+  int max;
+
+  argaddr(0, &user_buf);
+  argint(1, &max);
+
+  return wait_alerts(user_buf, max);
+}
+
+uint64
+sys_get_alert_stats(void)
+{
+  uint64 user_stats;
+  struct alert_stats stats;
+
+  argaddr(0, &user_stats);
+
+  get_alert_stats(&stats);
+
+  if(copyout(myproc()->pagetable, user_stats, (char*)&stats, sizeof(stats)) < 0)
+    return -1;
+
   return 0;
-}
\ No newline at end of file
+}
+
+uint64
+sys_set_alert_console(void)
+{
+  int mode;
+
+  argint(0, &mode);
+
+  return set_alert_console(mode);
+}
+
+uint64
+sys_set_watchlist(void)
+{
+  uint64 user_entries;
+  int n;
+
+  argaddr(0, &user_entries);
+  argint(1, &n);
+
+  return set_watchlist(user_entries, n);
+}
+
+uint64
+sys_get_watchlist(void)
+{
+  uint64 user_entries;
+  int max;
+
+  argaddr(0, &user_entries);
+  argint(1, &max);
+
+  return get_watchlist(user_entries, max);
+}
+
+uint64
+sys_set_baselines(void)
+{
+  uint64 user_baselines;
+  int n;
+
+  argaddr(0, &user_baselines);
+  argint(1, &n);
+
+  return set_baselines(user_baselines, n);
+}
+
+uint64
+sys_get_baselines(void)
+{
+  uint64 user_baselines;
+  int max;
+
+  argaddr(0, &user_baselines);
+  argint(1, &max);
+
+  return get_baselines(user_baselines, max);
+}
+
+uint64
+sys_get_file_cardinality(void)
+{
+  int pid;
+  uint64 user_card;
+
+  argint(0, &pid);
+  argaddr(1, &user_card);
+
+  return get_file_cardinality(pid, user_card);
+}
+
+uint64
+sys_get_session_stats(void)
+{
+  int sid;
+  uint64 user_stats;
+
+  argint(0, &sid);
+  argaddr(1, &user_stats);
+
+  return get_session_stats(sid, user_stats);
+}
+
+// set the overflow policy of a log retention class.
+uint64
+sys_set_log_policy(void)
+{
+  int class, policy;
+
+  argint(0, &class);
+  argint(1, &policy);
+  return set_log_policy(class, policy);
+}
+
+// copy out the policy and counters of every retention class.
+uint64
+sys_get_log_policy(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return get_log_policy(addr);
+}
@@ -0,0 +1,10 @@
+#ifndef TIME_H
+#define TIME_H
+
+// Wall-clock time, as returned by clock_gettime()
+struct timespec {
+    uint64 tv_sec;   // seconds since 1970-01-01
+    uint64 tv_nsec;  // nanoseconds, 0 to 999999999
+};
+
+#endif
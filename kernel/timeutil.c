@@ -4,48 +4,29 @@
 #include "spinlock.h"
 #include "defs.h"
 #include "boottime.h"
+#include "timeutil.h"
 
 
-// System boot time (initialized with default values)
+// Build time, from boottime.h; the clock falls back to it when
+// there is no RTC
 struct rtcdate boot_time;
 
-// Month names for formatting
-static char *month_names[] = {"", "Jan", "Feb", "Mar", "Apr", "May", "Jun", 
-                             "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+// The wall clock is the RTC reading taken at boot plus the cycles
+// of the RISC-V time CSR since then, so reading it needs no MMIO.
+static uint64 base_ns;      // nanoseconds since 1970-01-01 at base_cycles
+static uint64 base_cycles;  // r_time() when base_ns was taken
 
-// Day names for formatting
-static char *day_names[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
-
-// Days in each month (non-leap year)
-static int days_in_month[] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-
-// Check if a year is leap year
-static int 
-is_leap_year(int year) 
+// Days from 1970-01-01 to the given civil date, in constant time
+// (Howard Hinnant's days_from_civil)
+static int
+days_from_civil(int year, int month, int day)
 {
-  return (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
-}
-
-// Get days in given month of given year
-static int 
-get_days_in_month(int year, int month) 
-{
-  if (month == 2 && is_leap_year(year))
-    return 29;
-  return days_in_month[month];
-}
-
-// Calculate day of week (0=Sunday, 6=Saturday)
-// Using Zeller's Congruence algorithm
-static int 
-day_of_week(int year, int month, int day) 
-{
-  if (month < 3) {
-    month += 12;
-    year--;
-  }
-  int h = (day + (13*(month+1))/5 + year + year/4 - year/100 + year/400) % 7;
-  return (h + 6) % 7; // Adjust to make Sunday=0
+  year -= month <= 2;
+  int era = (year >= 0 ? year : year - 399) / 400;
+  uint yoe = year - era * 400;                                  // [0, 399]
+  uint doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;             // [0, 146096]
+  return era * 146097 + (int)doe - 719468;
 }
 
 // Initialize the timeutil module
@@ -59,108 +40,38 @@ timeutil_init(void)
   boot_time.day = BOOT_DAY;
   boot_time.month = BOOT_MONTH;
   boot_time.year = BOOT_YEAR;
+
+  base_cycles = r_time();
+  base_ns = rtc_read();
+  if(base_ns == 0){
+    uint64 secs = (uint64)days_from_civil(boot_time.year, boot_time.month, boot_time.day) * 86400 +
+                  boot_time.hour * 3600 + boot_time.minute * 60 + boot_time.second;
+    base_ns = secs * NS_PER_SEC;
+    printf("timeutil: no RTC, using the build time\n");
+  }
 }
 
-// Format timestamp from ticks into provided buffer
-// Buffer should be at least 25 characters
-void 
-format_timestamp(uint ticks, char *buf, int bufsize) 
+// Current time in nanoseconds since 1970-01-01
+uint64
+clock_ns(void)
 {
-  if (bufsize < 25) {
-    if (bufsize > 0)
-      buf[0] = '\0';
-    return;
-  }
+  return base_ns + (r_time() - base_cycles) * NS_PER_CYCLE;
+}
 
-  // Clear the buffer to ensure no stale data interferes
-  memset(buf, 0, bufsize);
+// Current time in seconds since 1970-01-01. Log records store
+// this raw value; tools format it in user space (user/timefmt.c).
+uint
+current_time(void)
+{
+  return clock_ns() / NS_PER_SEC;
+}
 
-  // Convert ticks to time elapsed
-  uint seconds_elapsed = ticks / 10;  // ticks are in 0.1 second increments
-  
-  // Copy boot time values to working variables
-  uint seconds = boot_time.second;
-  uint minutes = boot_time.minute;
-  uint hours = boot_time.hour;
-  uint day = boot_time.day;
-  uint month = boot_time.month;
-  uint year = boot_time.year;
-  
-  // Add elapsed time
-  seconds += seconds_elapsed % 60;
-  minutes += (seconds_elapsed / 60) % 60;
-  hours += (seconds_elapsed / 3600);
-  
-  // Adjust for overflow
-  if (seconds >= 60) {
-    minutes++;
-    seconds %= 60;
-  }
-  
-  if (minutes >= 60) {
-    hours++;
-    minutes %= 60;
-  }
-  
-  uint days_elapsed = hours / 24;
-  hours %= 24;
-  
-  // Add days one by one
-  for (uint i = 0; i < days_elapsed; i++) {
-    day++;
-    if (day > get_days_in_month(year, month)) {
-      day = 1;
-      month++;
-      if (month > 12) {
-        month = 1;
-        year++;
-      }
-    }
-  }
-  
-  // Get day of week
-  int dow = day_of_week(year, month, day);
-  
-  // Copy day name (3 chars)
-  for (int i = 0; i < 3 && day_names[dow][i]; i++) {
-    buf[i] = day_names[dow][i];
-  }
-  
-  // Add space
-  buf[3] = ' ';
-  
-  // Copy month name (3 chars)
-  for (int i = 0; i < 3 && month_names[month][i]; i++) {
-    buf[4+i] = month_names[month][i];
-  }
-  
-  // Complete the rest manually
-  buf[7] = ' ';
-  
-  // Format day
-  if (day < 10) {
-    buf[8] = ' ';
-    buf[9] = '0' + day;
-  } else {
-    buf[8] = '0' + (day / 10);
-    buf[9] = '0' + (day % 10);
-  }
-  
-  buf[10] = ' ';
-  buf[11] = '0' + (hours / 10);
-  buf[12] = '0' + (hours % 10);
-  buf[13] = ':';
-  buf[14] = '0' + (minutes / 10);
-  buf[15] = '0' + (minutes % 10);
-  buf[16] = ':';
-  buf[17] = '0' + (seconds / 10);
-  buf[18] = '0' + (seconds % 10);
-  buf[19] = ' ';
-  buf[20] = '0' + (year / 1000);
-  buf[21] = '0' + ((year / 100) % 10);
-  buf[22] = '0' + ((year / 10) % 10);
-  buf[23] = '0' + (year % 10);
-  
-  // Ensure null-termination
-  buf[24] = '\0';
-}
\ No newline at end of file
+// Fill in a struct timespec for clock_gettime()
+void
+clock_now(struct timespec *ts)
+{
+  uint64 ns = clock_ns();
+
+  ts->tv_sec = ns / NS_PER_SEC;
+  ts->tv_nsec = ns % NS_PER_SEC;
+}
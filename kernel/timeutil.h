@@ -2,12 +2,22 @@
 #define TIMEUTIL_H
 
 #include "types.h"
+#include "time.h"
+
+// clockintr() fires about every 0.1 second
+#define TICKS_PER_SEC 10
+
+// qemu's virt machine runs the time CSR at 10 MHz
+#define NS_PER_SEC    1000000000ULL
+#define NS_PER_CYCLE  100
 
 // Global variables
 extern struct rtcdate boot_time;
 
 // Function prototypes
 void timeutil_init(void);
-void format_timestamp(uint ticks, char *buf, int bufsize);
+uint64 clock_ns(void);
+uint current_time(void);
+void clock_now(struct timespec *ts);
 
 #endif // TIMEUTIL_H
\ No newline at end of file
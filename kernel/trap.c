@@ -196,6 +196,8 @@ devintr()
       uartintr();
     } else if(irq == VIRTIO0_IRQ){
       virtio_disk_intr();
+    } else if(irq == VIRTIO1_IRQ){
+      virtio_console_intr();
     } else if(irq){
       printf("unexpected interrupt irq=%d\n", irq);
     }
@@ -0,0 +1,211 @@
+//
+// driver for qemu's virtio console device, used as a
+// write-only channel to the host for exported audit logs.
+// uses qemu's mmio interface to virtio.
+//
+// qemu ... -chardev file,id=audit0,path=audit.out
+//          -device virtio-serial-device,bus=virtio-mmio-bus.1
+//          -device virtconsole,chardev=audit0
+//
+// without VIRTIO_CONSOLE_F_MULTIPORT the device has a single
+// port, whose transmit queue is queue 1.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "virtio.h"
+
+// the address of virtio mmio register r.
+#define R(r) ((volatile uint32 *)(VIRTIO1 + (r)))
+
+#define TRANSMITQ 1
+
+static struct vcons {
+  // one descriptor per buffer; buffers are never chained.
+  struct virtq_desc *desc;
+  struct virtq_avail *avail;
+  struct virtq_used *used;
+
+  char free[NUM];  // is a descriptor free?
+  uint16 used_idx; // we've looked this far in used[2..NUM].
+
+  // the page each in-flight descriptor points at,
+  // freed when the device is done with it.
+  void *page[NUM];
+
+  int present;     // found the device at boot?
+
+  struct spinlock lock;
+} vcons;
+
+void
+virtio_console_init(void)
+{
+  uint32 status = 0;
+
+  initlock(&vcons.lock, "virtio_console");
+
+  // the channel is optional: run without it, exporting nothing.
+  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(VIRTIO_MMIO_VERSION) != 2 ||
+     *R(VIRTIO_MMIO_DEVICE_ID) != 3 ||
+     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    printf("virtio console: not found, audit export disabled\n");
+    return;
+  }
+
+  // reset device
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // set ACKNOWLEDGE status bit
+  status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // set DRIVER status bit
+  status |= VIRTIO_CONFIG_S_DRIVER;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // negotiate features
+  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  features &= ~(1 << VIRTIO_CONSOLE_F_SIZE);
+  features &= ~(1 << VIRTIO_CONSOLE_F_MULTIPORT);
+  features &= ~(1 << VIRTIO_CONSOLE_F_EMERG_WRITE);
+  features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
+  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
+  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+
+  // tell device that feature negotiation is complete.
+  status |= VIRTIO_CONFIG_S_FEATURES_OK;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  // re-read status to ensure FEATURES_OK is set.
+  status = *R(VIRTIO_MMIO_STATUS);
+  if(!(status & VIRTIO_CONFIG_S_FEATURES_OK))
+    panic("virtio console FEATURES_OK unset");
+
+  // initialize the transmit queue; the receive queue
+  // is left unset, nothing is ever read from the host.
+  *R(VIRTIO_MMIO_QUEUE_SEL) = TRANSMITQ;
+
+  if(*R(VIRTIO_MMIO_QUEUE_READY))
+    panic("virtio console should not be ready");
+
+  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  if(max == 0)
+    panic("virtio console has no transmit queue");
+  if(max < NUM)
+    panic("virtio console max queue too short");
+
+  // allocate and zero queue memory.
+  vcons.desc = kalloc();
+  vcons.avail = kalloc();
+  vcons.used = kalloc();
+  if(!vcons.desc || !vcons.avail || !vcons.used)
+    panic("virtio console kalloc");
+  memset(vcons.desc, 0, PGSIZE);
+  memset(vcons.avail, 0, PGSIZE);
+  memset(vcons.used, 0, PGSIZE);
+
+  // set queue size.
+  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+
+  // write physical addresses.
+  *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)vcons.desc;
+  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)vcons.desc >> 32;
+  *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)vcons.avail;
+  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)vcons.avail >> 32;
+  *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)vcons.used;
+  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)vcons.used >> 32;
+
+  // queue is ready.
+  *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
+
+  // all NUM descriptors start out unused.
+  for(int i = 0; i < NUM; i++)
+    vcons.free[i] = 1;
+
+  // tell device we're completely ready.
+  status |= VIRTIO_CONFIG_S_DRIVER_OK;
+  *R(VIRTIO_MMIO_STATUS) = status;
+
+  vcons.present = 1;
+}
+
+// hand the first len bytes of a kalloc()ed page to the device.
+// the device reads it straight from memory; the page is freed
+// by virtio_console_intr() once the device is done.
+// never sleeps: returns -1, leaving the page to the caller,
+// if the device is missing or all descriptors are in flight.
+int
+virtio_console_send(void *page, int len)
+{
+  int idx;
+
+  if(!vcons.present)
+    return -1;
+
+  acquire(&vcons.lock);
+
+  for(idx = 0; idx < NUM; idx++)
+    if(vcons.free[idx])
+      break;
+  if(idx == NUM){
+    release(&vcons.lock);
+    return -1;
+  }
+  vcons.free[idx] = 0;
+  vcons.page[idx] = page;
+
+  vcons.desc[idx].addr = (uint64) page;
+  vcons.desc[idx].len = len;
+  vcons.desc[idx].flags = 0; // device reads the buffer
+  vcons.desc[idx].next = 0;
+
+  // tell the device the descriptor is available.
+  vcons.avail->ring[vcons.avail->idx % NUM] = idx;
+
+  __sync_synchronize();
+
+  // tell the device another avail ring entry is available.
+  vcons.avail->idx += 1; // not % NUM ...
+
+  __sync_synchronize();
+
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = TRANSMITQ; // value is queue number
+
+  release(&vcons.lock);
+  return 0;
+}
+
+void
+virtio_console_intr(void)
+{
+  acquire(&vcons.lock);
+
+  // ack first, as virtio_disk_intr() does; completions that
+  // race with the ack are picked up by the loop below.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+  __sync_synchronize();
+
+  while(vcons.used_idx != vcons.used->idx){
+    __sync_synchronize();
+    int id = vcons.used->ring[vcons.used_idx % NUM].id;
+
+    if(id >= NUM || vcons.free[id])
+      panic("virtio_console_intr");
+
+    kfree(vcons.page[id]);
+    vcons.page[id] = 0;
+    vcons.free[id] = 1;
+
+    vcons.used_idx += 1;
+  }
+
+  release(&vcons.lock);
+}
@@ -0,0 +1,278 @@
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "defs.h"
+
+// Watchlist of protected paths, kept as a radix tree over path
+// components. Children are found through one hash table keyed by
+// (parent node, component), so a lookup costs one probe per path
+// component: O(path length), independent of the watchlist size.
+
+#define WL_NODES    (MAX_WATCHLIST * 8)
+#define WL_BUCKETS  (2 * WL_NODES)
+
+struct wl_node {
+    int parent;               // index of the parent node, -1 for root
+    uint hash;                // hash of name
+    char name[DIRSIZ];        // path component
+    int flags;                // WL_* set by an entry ending here
+};
+
+struct {
+    struct spinlock lock;
+    struct wl_node nodes[WL_NODES];
+    int nnodes;
+    short buckets[WL_BUCKETS];  // node index + 1, 0 if empty
+    struct watchlist_entry entries[MAX_WATCHLIST];
+    int nentries;
+} watchlist;
+
+// Hash one component, truncated to DIRSIZ like the file system does
+static uint
+comp_hash(char *s, int len)
+{
+    uint h = 2166136261;
+    for(int i = 0; i < len && i < DIRSIZ; i++) {
+        h = (h ^ (uchar)s[i]) * 16777619;
+    }
+    return h;
+}
+
+static int
+comp_eq(struct wl_node *n, char *s, int len)
+{
+    if(len > DIRSIZ) {
+        len = DIRSIZ;
+    }
+    if(strncmp(n->name, s, len) != 0) {
+        return 0;
+    }
+    return len == DIRSIZ || n->name[len] == 0;
+}
+
+// Child of parent named s[0..len-1], or -1.
+// Caller must hold watchlist.lock.
+static int
+find_child(int parent, char *s, int len, uint h)
+{
+    uint b = (h ^ (parent * 2654435761U)) % WL_BUCKETS;
+
+    for(int i = 0; i < WL_BUCKETS; i++) {
+        int slot = watchlist.buckets[(b + i) % WL_BUCKETS];
+        if(slot == 0) {
+            return -1;
+        }
+        struct wl_node *n = &watchlist.nodes[slot - 1];
+        if(n->parent == parent && n->hash == h && comp_eq(n, s, len)) {
+            return slot - 1;
+        }
+    }
+    return -1;
+}
+
+static int
+add_child(int parent, char *s, int len, uint h)
+{
+    if(watchlist.nnodes == WL_NODES) {
+        return -1;
+    }
+
+    int idx = watchlist.nnodes++;
+    struct wl_node *n = &watchlist.nodes[idx];
+    n->parent = parent;
+    n->hash = h;
+    n->flags = 0;
+    memset(n->name, 0, DIRSIZ);
+    memmove(n->name, s, len < DIRSIZ ? len : DIRSIZ);
+
+    uint b = (h ^ (parent * 2654435761U)) % WL_BUCKETS;
+    for(int i = 0; i < WL_BUCKETS; i++) {
+        short *slot = &watchlist.buckets[(b + i) % WL_BUCKETS];
+        if(*slot == 0) {
+            *slot = idx + 1;
+            return idx;
+        }
+    }
+    return -1;
+}
+
+// Split the next component off *pathp, returns its length, 0 at the end
+static int
+next_comp(char **pathp, char **comp)
+{
+    char *s = *pathp;
+
+    while(*s == '/') {
+        s++;
+    }
+    *comp = s;
+    while(*s && *s != '/') {
+        s++;
+    }
+    *pathp = s;
+    return s - *comp;
+}
+
+// Insert one entry. Caller must hold watchlist.lock.
+static int
+insert_entry(struct watchlist_entry *e)
+{
+    char *path = e->path;
+    char *comp;
+    int len;
+    int cur = 0;
+
+    while((len = next_comp(&path, &comp)) > 0) {
+        if(len == 1 && comp[0] == '.') {
+            continue;
+        }
+        if(len == 2 && comp[0] == '.' && comp[1] == '.') {
+            return -1;
+        }
+        uint h = comp_hash(comp, len);
+        int child = find_child(cur, comp, len, h);
+        if(child < 0 && (child = add_child(cur, comp, len, h)) < 0) {
+            return -1;
+        }
+        cur = child;
+    }
+    watchlist.nodes[cur].flags |= e->flags;
+    return 0;
+}
+
+// Reset the tree to a bare root. Caller must hold watchlist.lock.
+static void
+reset_tree(void)
+{
+    memset(watchlist.buckets, 0, sizeof(watchlist.buckets));
+    watchlist.nnodes = 1;
+    watchlist.nodes[0].parent = -1;
+    watchlist.nodes[0].flags = 0;
+    watchlist.nodes[0].name[0] = 0;
+}
+
+void
+watchlist_init(void)
+{
+    initlock(&watchlist.lock, "watchlist");
+    watchlist.nentries = 0;
+    reset_tree();
+}
+
+// WL_* flags of every watchlist entry that is a prefix of path.
+// Paths are matched as if relative to the root directory.
+int
+watchlist_lookup(char *path)
+{
+    char *comp;
+    int len;
+    int cur = 0;
+    int below = 0;   // components walked past the deepest node
+    int flags = 0;
+
+    acquire(&watchlist.lock);
+    if(watchlist.nentries == 0) {
+        release(&watchlist.lock);
+        return 0;
+    }
+
+    while((len = next_comp(&path, &comp)) > 0) {
+        if(len == 1 && comp[0] == '.') {
+            continue;
+        }
+        if(len == 2 && comp[0] == '.' && comp[1] == '.') {
+            if(below > 0) {
+                below--;
+            } else if(cur != 0) {
+                cur = watchlist.nodes[cur].parent;
+            }
+            continue;
+        }
+        if(below > 0) {
+            below++;
+            continue;
+        }
+        int child = find_child(cur, comp, len, comp_hash(comp, len));
+        if(child < 0) {
+            below++;
+        } else {
+            cur = child;
+        }
+    }
+
+    // Entries ending at cur or any of its ancestors cover the path
+    for(; cur >= 0; cur = watchlist.nodes[cur].parent) {
+        flags |= watchlist.nodes[cur].flags;
+    }
+    release(&watchlist.lock);
+    return flags;
+}
+
+// Replace the watchlist with n entries copied from user space
+int
+set_watchlist(uint64 user_entries, int n)
+{
+    if(n < 0 || n > MAX_WATCHLIST) {
+        return -1;
+    }
+
+    struct watchlist_entry *tmp = (struct watchlist_entry*)kalloc();
+    if(tmp == 0) {
+        return -1;
+    }
+    if(n > 0 && copyin(myproc()->pagetable, (char*)tmp, user_entries,
+                       n * sizeof(struct watchlist_entry)) < 0) {
+        kfree(tmp);
+        return -1;
+    }
+
+    acquire(&watchlist.lock);
+    reset_tree();
+    for(int i = 0; i < n; i++) {
+        tmp[i].path[WATCHLIST_PATH-1] = 0;
+        if(insert_entry(&tmp[i]) < 0) {
+            // out of nodes or a ".." entry: keep the old watchlist
+            reset_tree();
+            for(int j = 0; j < watchlist.nentries; j++) {
+                insert_entry(&watchlist.entries[j]);
+            }
+            release(&watchlist.lock);
+            kfree(tmp);
+            return -1;
+        }
+    }
+    memmove(watchlist.entries, tmp, n * sizeof(struct watchlist_entry));
+    watchlist.nentries = n;
+    release(&watchlist.lock);
+
+    kfree(tmp);
+    return n;
+}
+
+// Copy the watchlist entries to user space, returns the number copied
+int
+get_watchlist(uint64 user_entries, int max)
+{
+    struct watchlist_entry *tmp = (struct watchlist_entry*)kalloc();
+    if(tmp == 0) {
+        return -1;
+    }
+
+    acquire(&watchlist.lock);
+    int n = watchlist.nentries;
+    memmove(tmp, watchlist.entries, n * sizeof(struct watchlist_entry));
+    release(&watchlist.lock);
+
+    if(n > max) {
+        n = max < 0 ? 0 : max;
+    }
+    if(n > 0 && copyout(myproc()->pagetable, user_entries, (char*)tmp,
+                        n * sizeof(struct watchlist_entry)) < 0) {
+        n = -1;
+    }
+    kfree(tmp);
+    return n;
+}
@@ -38,7 +38,7 @@ void wsect(uint, void*);
 void winode(uint, struct dinode*);
 void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
-uint ialloc(ushort type);
+uint ialloc(ushort type, uchar audit);
 void iappend(uint inum, void *p, int n);
 void die(const char *);
 
@@ -78,7 +78,7 @@ main(int argc, char *argv[])
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs fs.img [-a|-c] files...\n");
     exit(1);
   }
 
@@ -114,7 +114,7 @@ main(int argc, char *argv[])
   memmove(buf, &sb, sizeof(sb));
   wsect(1, buf);
 
-  rootino = ialloc(T_DIR);
+  rootino = ialloc(T_DIR, 0);
   assert(rootino == ROOTINO);
 
   bzero(&de, sizeof(de));
@@ -128,6 +128,17 @@ main(int argc, char *argv[])
   iappend(rootino, &de, sizeof(de));
 
   for(i = 2; i < argc; i++){
+    // "-a" marks the next file as audited (IA_AUDIT),
+    // "-c" as a canary (IA_CANARY)
+    uchar audit = 0;
+    if(strcmp(argv[i], "-a") == 0 && i + 1 < argc){
+      audit = IA_AUDIT;
+      i++;
+    } else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc){
+      audit = IA_CANARY;
+      i++;
+    }
+
     // get rid of "user/"
     char *shortname;
     if(strncmp(argv[i], "user/", 5) == 0)
@@ -149,7 +160,7 @@ main(int argc, char *argv[])
 
     assert(strlen(shortname) <= DIRSIZ);
     
-    inum = ialloc(T_FILE);
+    inum = ialloc(T_FILE, audit);
 
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
@@ -220,13 +231,14 @@ rsect(uint sec, void *buf)
 }
 
 uint
-ialloc(ushort type)
+ialloc(ushort type, uchar audit)
 {
   uint inum = freeinode++;
   struct dinode din;
 
   bzero(&din, sizeof(din));
-  din.type = xshort(type);
+  din.type = type;
+  din.audit = audit;
   din.nlink = xshort(1);
   din.size = xint(0);
   winode(inum, &din);
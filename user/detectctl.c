@@ -0,0 +1,641 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/syscall.h"
+#include "user/user.h"
+
+// detectctl: inspect and load the kernel's detection rules.
+//
+// A rule is a list of key=value words:
+//   ops=open,read,...   operations matched (default any)
+//   status=ok|fail|any  status matched (default any)
+//   rate=N              threshold per process (default 1)
+//   metric=rate|files   rate counts events per second, files distinct
+//                       files in the last 30 to 60 seconds (default rate)
+//   scope=proc|session  count each process alone, or all processes of
+//                       its session together (default proc)
+//   action=alert|ignore|throttle
+//                       what to do on a match (default alert); throttle
+//                       also rate-limits the process's open, write and
+//                       unlink calls for ten seconds
+//   proc=name           exact process name (default any)
+//   prefix=/path        leading path components (default any)
+//
+// "detectctl watch ..." manages the watchlist of protected paths,
+// "detectctl audit ...", "detectctl canary ..." and "detectctl fim
+// <path> on|off" the audit flags
+// stored in a file's inode, and "detectctl baseline ..." the learned
+// per-program baselines, which can be saved to a file and loaded
+// back after a reboot. "detectctl files <pid>" estimates how many
+// distinct files a process touched recently, and "detectctl session
+// <sid>" reports the activity of a whole session. "detectctl fim
+// <path> root|baseline|check" reads an IA_FIM file's integrity hash,
+// records it as the baseline or checks the file against it, and
+// "load <hash>" restores a saved baseline. "detectctl
+// syscalls ..." picks the syscalls the kernel's generic audit hook
+// logs; each change is itself logged as an AUDIT record.
+
+static char *op_names[NOPS] = {
+    [OP_OPEN] "open", [OP_READ] "read", [OP_WRITE] "write",
+    [OP_CLOSE] "close", [OP_CREATE] "create", [OP_DELETE] "delete",
+    [OP_CHDIR] "chdir", [OP_EXEC] "exec", [OP_LINK] "link",
+    [OP_MKDIR] "mkdir", [OP_MKNOD] "mknod", [OP_DUP] "dup",
+    [OP_PIPE] "pipe", [OP_FORK] "fork",
+};
+
+static struct detect_rule rules[MAX_RULES];
+static struct watchlist_entry watches[MAX_WATCHLIST];
+static struct prog_baseline baselines[MAX_BASELINES];
+
+static int
+prefixeq(const char *s, const char *prefix)
+{
+    while(*prefix) {
+        if(*s++ != *prefix++)
+            return 0;
+    }
+    return 1;
+}
+
+static void
+copyfield(char *dst, const char *src, int n)
+{
+    int i;
+    for(i = 0; i < n - 1 && src[i]; i++)
+        dst[i] = src[i];
+    dst[i] = 0;
+}
+
+// Parse a comma-separated operation list into an op mask
+static int
+parse_ops(char *s, uint *mask)
+{
+    *mask = 0;
+    if(strcmp(s, "any") == 0)
+        return 0;
+
+    while(*s) {
+        char name[16];
+        int n = 0;
+        while(*s && *s != ',' && n < sizeof(name) - 1)
+            name[n++] = *s++;
+        name[n] = 0;
+        if(*s == ',')
+            s++;
+
+        int op;
+        for(op = 1; op < NOPS; op++) {
+            if(strcmp(name, op_names[op]) == 0)
+                break;
+        }
+        if(op == NOPS) {
+            fprintf(2, "detectctl: unknown operation '%s'\n", name);
+            return -1;
+        }
+        *mask |= 1 << op;
+    }
+    return 0;
+}
+
+// Parse one key=value word into r
+static int
+parse_word(struct detect_rule *r, char *w)
+{
+    if(prefixeq(w, "ops="))
+        return parse_ops(w + 4, &r->opmask);
+    if(prefixeq(w, "status=")) {
+        w += 7;
+        if(strcmp(w, "ok") == 0)
+            r->status = RULE_ST_OK;
+        else if(strcmp(w, "fail") == 0)
+            r->status = RULE_ST_FAIL;
+        else if(strcmp(w, "any") == 0)
+            r->status = RULE_ST_ANY;
+        else
+            goto bad;
+        return 0;
+    }
+    if(prefixeq(w, "rate=")) {
+        r->rate = atoi(w + 5);
+        return 0;
+    }
+    if(prefixeq(w, "metric=")) {
+        w += 7;
+        if(strcmp(w, "rate") == 0)
+            r->metric = RULE_M_RATE;
+        else if(strcmp(w, "files") == 0)
+            r->metric = RULE_M_FILES;
+        else
+            goto bad;
+        return 0;
+    }
+    if(prefixeq(w, "scope=")) {
+        w += 6;
+        if(strcmp(w, "proc") == 0)
+            r->scope = RULE_SCOPE_PROC;
+        else if(strcmp(w, "session") == 0)
+            r->scope = RULE_SCOPE_SESSION;
+        else
+            goto bad;
+        return 0;
+    }
+    if(prefixeq(w, "action=")) {
+        w += 7;
+        if(strcmp(w, "alert") == 0)
+            r->action = RULE_ACT_ALERT;
+        else if(strcmp(w, "ignore") == 0)
+            r->action = RULE_ACT_IGNORE;
+        else if(strcmp(w, "throttle") == 0)
+            r->action = RULE_ACT_THROTTLE;
+        else
+            goto bad;
+        return 0;
+    }
+    if(prefixeq(w, "proc=")) {
+        copyfield(r->proc_name, w + 5, sizeof(r->proc_name));
+        return 0;
+    }
+    if(prefixeq(w, "prefix=")) {
+        copyfield(r->prefix, w + 7, sizeof(r->prefix));
+        return 0;
+    }
+
+bad:
+    fprintf(2, "detectctl: bad rule word '%s'\n", w);
+    return -1;
+}
+
+static void
+rule_defaults(struct detect_rule *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->status = RULE_ST_ANY;
+    r->rate = 1;
+    r->action = RULE_ACT_ALERT;
+}
+
+// Parse a rule from a line of text, splitting it in place
+static int
+parse_line(struct detect_rule *r, char *line)
+{
+    rule_defaults(r);
+    while(*line) {
+        while(*line == ' ' || *line == '\t')
+            line++;
+        if(*line == 0)
+            break;
+        char *w = line;
+        while(*line && *line != ' ' && *line != '\t')
+            line++;
+        if(*line)
+            *line++ = 0;
+        if(parse_word(r, w) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void
+print_rule(int i, struct detect_rule *r)
+{
+    printf("%d: ops=", i);
+    if(r->opmask == 0) {
+        printf("any");
+    } else {
+        int first = 1;
+        for(int op = 1; op < NOPS; op++) {
+            if(r->opmask & (1 << op)) {
+                printf("%s%s", first ? "" : ",", op_names[op]);
+                first = 0;
+            }
+        }
+    }
+    printf(" status=%s", r->status == RULE_ST_OK ? "ok" :
+                         r->status == RULE_ST_FAIL ? "fail" : "any");
+    printf(" rate=%d action=%s", r->rate,
+           r->action == RULE_ACT_IGNORE ? "ignore" :
+           r->action == RULE_ACT_THROTTLE ? "throttle" : "alert");
+    if(r->metric == RULE_M_FILES)
+        printf(" metric=files");
+    if(r->scope == RULE_SCOPE_SESSION)
+        printf(" scope=session");
+    if(r->proc_name[0])
+        printf(" proc=%s", r->proc_name);
+    if(r->prefix[0])
+        printf(" prefix=%s", r->prefix);
+    printf("\n");
+}
+
+static int
+load_file(char *path)
+{
+    char line[128];
+    int fd, n = 0, len = 0;
+    char c;
+
+    if((fd = open(path, O_RDONLY)) < 0) {
+        fprintf(2, "detectctl: cannot open %s\n", path);
+        return -1;
+    }
+    for(;;) {
+        int got = read(fd, &c, 1);
+        if(got == 1 && c != '\n' && len < sizeof(line) - 1) {
+            line[len++] = c;
+            continue;
+        }
+        line[len] = 0;
+        if(len > 0 && line[0] != '#') {
+            if(n == MAX_RULES) {
+                fprintf(2, "detectctl: more than %d rules\n", MAX_RULES);
+                close(fd);
+                return -1;
+            }
+            if(parse_line(&rules[n], line) < 0) {
+                close(fd);
+                return -1;
+            }
+            n++;
+        }
+        len = 0;
+        if(got != 1)
+            break;
+    }
+    close(fd);
+    return n;
+}
+
+static void
+usage(void)
+{
+    fprintf(2, "Usage: detectctl [list]\n");
+    fprintf(2, "       detectctl reset | clear\n");
+    fprintf(2, "       detectctl load <file>\n");
+    fprintf(2, "       detectctl add key=value...\n");
+    fprintf(2, "       detectctl del <index>\n");
+    fprintf(2, "       detectctl watch [list | clear]\n");
+    fprintf(2, "       detectctl watch add <path> [log|alert|both]\n");
+    fprintf(2, "       detectctl watch del <path>\n");
+    fprintf(2, "       detectctl audit <path> [on|off]\n");
+    fprintf(2, "       detectctl canary <path> [on|off]\n");
+    fprintf(2, "       detectctl fim <path> [on|off|root|baseline|check]\n");
+    fprintf(2, "       detectctl fim <path> load <hash>\n");
+    fprintf(2, "       detectctl baseline [list | clear]\n");
+    fprintf(2, "       detectctl baseline save|load <file>\n");
+    fprintf(2, "       detectctl files <pid>\n");
+    fprintf(2, "       detectctl session <sid>\n");
+    fprintf(2, "       detectctl syscalls [<name> on|off]\n");
+    exit(1);
+}
+
+// Show or change one inode flag (IA_AUDIT or IA_CANARY) of a file,
+// leaving its other flags alone
+static int
+audit_main(int argc, char *argv[], int bit)
+{
+    int flags = set_audit(argv[2], -1);
+    if(flags < 0) {
+        fprintf(2, "detectctl: cannot access %s\n", argv[2]);
+        exit(1);
+    }
+
+    if(argc == 4 && strcmp(argv[3], "on") == 0)
+        flags |= bit;
+    else if(argc == 4 && strcmp(argv[3], "off") == 0)
+        flags &= ~bit;
+    else if(argc != 3)
+        usage();
+
+    if(argc == 4 && set_audit(argv[2], flags) < 0) {
+        fprintf(2, "detectctl: cannot access %s\n", argv[2]);
+        exit(1);
+    }
+    printf("%s: %s %s\n", argv[2], argv[1], (flags & bit) ? "on" : "off");
+    exit(0);
+}
+
+// Syscalls the kernel's audit hook can log
+static struct {
+    char *name;
+    int num;
+} auditcalls[] = {
+    { "exec", SYS_exec }, { "link", SYS_link }, { "mkdir", SYS_mkdir },
+    { "mknod", SYS_mknod }, { "dup", SYS_dup }, { "pipe", SYS_pipe },
+    { "fork", SYS_fork },
+};
+#define NAUDITCALLS (sizeof(auditcalls) / sizeof(auditcalls[0]))
+
+// Show the audited syscalls, or switch one on or off
+static int
+syscalls_main(int argc, char *argv[])
+{
+    uint64 mask;
+
+    if(argc == 2) {
+        mask = syscall_audit(0, 0);
+    } else if(argc == 4) {
+        int i;
+        for(i = 0; i < NAUDITCALLS; i++) {
+            if(strcmp(argv[2], auditcalls[i].name) == 0)
+                break;
+        }
+        if(i == NAUDITCALLS) {
+            fprintf(2, "detectctl: cannot audit syscall '%s'\n", argv[2]);
+            exit(1);
+        }
+        uint64 bit = 1L << auditcalls[i].num;
+        if(strcmp(argv[3], "on") == 0)
+            mask = syscall_audit(bit, 0);
+        else if(strcmp(argv[3], "off") == 0)
+            mask = syscall_audit(0, bit);
+        else
+            usage();
+    } else {
+        usage();
+    }
+
+    for(int i = 0; i < NAUDITCALLS; i++) {
+        printf("%s: %s\n", auditcalls[i].name,
+               (mask & (1L << auditcalls[i].num)) ? "on" : "off");
+    }
+    exit(0);
+}
+
+// Integrity of an IA_FIM file
+static int
+fim_main(int argc, char *argv[])
+{
+    uint64 root;
+    int r;
+
+    if(argc == 3 || (argc == 4 && (strcmp(argv[3], "on") == 0 ||
+                                   strcmp(argv[3], "off") == 0)))
+        return audit_main(argc, argv, IA_FIM);
+
+    if(argc == 5 && strcmp(argv[3], "load") == 0) {
+        if(!hex64(argv[4], strlen(argv[4]), &root))
+            usage();
+        if(fim(argv[2], FIM_LOAD, &root) < 0) {
+            fprintf(2, "detectctl: %s is not integrity monitored\n", argv[2]);
+            exit(1);
+        }
+        printf("%s: baseline %lx\n", argv[2], root);
+        exit(0);
+    }
+
+    int op;
+    if(argc == 4 && strcmp(argv[3], "root") == 0)
+        op = FIM_ROOT;
+    else if(argc == 4 && strcmp(argv[3], "baseline") == 0)
+        op = FIM_BASELINE;
+    else if(argc == 4 && strcmp(argv[3], "check") == 0)
+        op = FIM_CHECK;
+    else
+        usage();
+
+    r = fim(argv[2], op, &root);
+    if(r < 0 && op == FIM_CHECK) {
+        fprintf(2, "detectctl: %s has no baseline or is not integrity monitored\n", argv[2]);
+        exit(1);
+    } else if(r < 0) {
+        fprintf(2, "detectctl: %s is not integrity monitored\n", argv[2]);
+        exit(1);
+    }
+    if(op == FIM_CHECK) {
+        printf("%s: %lx %s\n", argv[2], root, r ? "MODIFIED" : "ok");
+        exit(r);
+    }
+    printf("%s: %s %lx\n", argv[2], op == FIM_BASELINE ? "baseline" : "root", root);
+    exit(0);
+}
+
+// Print a BL_FRAC fixed-point value with two decimals
+static void
+print_fixed(uint v)
+{
+    uint hundredths = ((v & ((1 << BL_FRAC) - 1)) * 100) >> BL_FRAC;
+    printf("%d.%s%d", v >> BL_FRAC, hundredths < 10 ? "0" : "", hundredths);
+}
+
+static int
+baseline_main(int argc, char *argv[])
+{
+    static char *metrics[BL_NMETRICS] = {
+        [BL_OPS] "ops", [BL_FAIL] "fail", [BL_FILES] "files", [BL_BYTES] "bytes",
+    };
+    int fd, n;
+
+    if(argc < 3 || strcmp(argv[2], "list") == 0) {
+        n = get_baselines(baselines, MAX_BASELINES);
+        if(n < 0) {
+            fprintf(2, "detectctl: cannot read baselines\n");
+            exit(1);
+        }
+        printf("%d baselines (mean/deviation per second):\n", n);
+        for(int i = 0; i < n; i++) {
+            struct prog_baseline *b = &baselines[i];
+            printf("%s samples=%d", b->proc_name, b->samples);
+            for(int m = 0; m < BL_NMETRICS; m++) {
+                printf(" %s=", metrics[m]);
+                print_fixed(b->mean[m]);
+                printf("/");
+                print_fixed(b->dev[m]);
+            }
+            printf("\n");
+        }
+        exit(0);
+    }
+
+    if(strcmp(argv[2], "clear") == 0) {
+        n = set_baselines(0, 0);
+    } else if(strcmp(argv[2], "save") == 0 && argc == 4) {
+        n = get_baselines(baselines, MAX_BASELINES);
+        if(n < 0 || (fd = open(argv[3], O_CREATE | O_WRONLY | O_TRUNC)) < 0) {
+            fprintf(2, "detectctl: cannot save baselines to %s\n", argv[3]);
+            exit(1);
+        }
+        if(write(fd, baselines, n * sizeof(struct prog_baseline)) !=
+           n * sizeof(struct prog_baseline)) {
+            fprintf(2, "detectctl: write to %s failed\n", argv[3]);
+            exit(1);
+        }
+        close(fd);
+        printf("%d baselines saved\n", n);
+        exit(0);
+    } else if(strcmp(argv[2], "load") == 0 && argc == 4) {
+        if((fd = open(argv[3], O_RDONLY)) < 0) {
+            fprintf(2, "detectctl: cannot open %s\n", argv[3]);
+            exit(1);
+        }
+        n = read(fd, baselines, sizeof(baselines));
+        close(fd);
+        if(n < 0 || n % sizeof(struct prog_baseline) != 0) {
+            fprintf(2, "detectctl: %s is not a baseline file\n", argv[3]);
+            exit(1);
+        }
+        n = set_baselines(baselines, n / sizeof(struct prog_baseline));
+    } else {
+        usage();
+    }
+
+    if(n < 0) {
+        fprintf(2, "detectctl: kernel rejected the baselines\n");
+        exit(1);
+    }
+    printf("%d baselines loaded\n", n);
+    exit(0);
+}
+
+static int
+watch_main(int argc, char *argv[])
+{
+    int n = get_watchlist(watches, MAX_WATCHLIST);
+    if(n < 0) {
+        fprintf(2, "detectctl: cannot read watchlist\n");
+        exit(1);
+    }
+
+    if(argc < 3 || strcmp(argv[2], "list") == 0) {
+        printf("%d watchlist entries:\n", n);
+        for(int i = 0; i < n; i++) {
+            int f = watches[i].flags;
+            printf("%s %s\n", watches[i].path,
+                   (f & WL_LOG) && (f & WL_ALERT) ? "both" :
+                   (f & WL_ALERT) ? "alert" : "log");
+        }
+        exit(0);
+    }
+
+    if(strcmp(argv[2], "clear") == 0) {
+        n = 0;
+    } else if(strcmp(argv[2], "add") == 0 && (argc == 4 || argc == 5)) {
+        int flags = WL_LOG | WL_ALERT;
+        if(argc == 5) {
+            if(strcmp(argv[4], "log") == 0)
+                flags = WL_LOG;
+            else if(strcmp(argv[4], "alert") == 0)
+                flags = WL_ALERT;
+            else if(strcmp(argv[4], "both") != 0)
+                usage();
+        }
+        if(n == MAX_WATCHLIST) {
+            fprintf(2, "detectctl: watchlist full\n");
+            exit(1);
+        }
+        copyfield(watches[n].path, argv[3], sizeof(watches[n].path));
+        watches[n].flags = flags;
+        n++;
+    } else if(strcmp(argv[2], "del") == 0 && argc == 4) {
+        int j = 0;
+        for(int i = 0; i < n; i++) {
+            if(strcmp(watches[i].path, argv[3]) != 0)
+                watches[j++] = watches[i];
+        }
+        n = j;
+    } else {
+        usage();
+    }
+
+    if(set_watchlist(watches, n) < 0) {
+        fprintf(2, "detectctl: kernel rejected the watchlist\n");
+        exit(1);
+    }
+    printf("%d watchlist entries loaded\n", n);
+    exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int n;
+
+    if(argc < 2 || strcmp(argv[1], "list") == 0) {
+        n = get_detect_rules(rules, MAX_RULES);
+        if(n < 0) {
+            fprintf(2, "detectctl: cannot read rules\n");
+            exit(1);
+        }
+        printf("%d detection rules:\n", n);
+        for(int i = 0; i < n; i++)
+            print_rule(i, &rules[i]);
+        exit(0);
+    }
+
+    if(strcmp(argv[1], "watch") == 0)
+        return watch_main(argc, argv);
+    if(strcmp(argv[1], "baseline") == 0)
+        return baseline_main(argc, argv);
+    if(strcmp(argv[1], "syscalls") == 0)
+        return syscalls_main(argc, argv);
+    if(strcmp(argv[1], "session") == 0 && argc == 3) {
+        struct session_stats st;
+        if(get_session_stats(atoi(argv[2]), &st) < 0) {
+            fprintf(2, "detectctl: no detector state for session %s\n", argv[2]);
+            exit(1);
+        }
+        printf("session %d: %d processes, %d events (%d failed)\n",
+               st.sid, st.procs, st.events, st.failures);
+        printf("  %d events in the last second, ~%d distinct files recently\n",
+               st.rate, st.distinct);
+        exit(0);
+    }
+    if(strcmp(argv[1], "files") == 0 && argc == 3) {
+        struct file_cardinality card;
+        if(get_file_cardinality(atoi(argv[2]), &card) < 0) {
+            fprintf(2, "detectctl: no detector state for pid %s\n", argv[2]);
+            exit(1);
+        }
+        printf("pid %s: ~%d distinct files in the last %d-%d seconds\n",
+               argv[2], card.recent, card.window, 2 * card.window);
+        printf("  current window ~%d, previous window ~%d\n",
+               card.current, card.previous);
+        exit(0);
+    }
+    if(strcmp(argv[1], "audit") == 0 && argc > 2)
+        return audit_main(argc, argv, IA_AUDIT);
+    if(strcmp(argv[1], "fim") == 0 && argc > 2)
+        return fim_main(argc, argv);
+    if(strcmp(argv[1], "canary") == 0 && argc > 2)
+        return audit_main(argc, argv, IA_CANARY);
+
+    if(strcmp(argv[1], "reset") == 0) {
+        n = set_detect_rules(0, -1);
+    } else if(strcmp(argv[1], "clear") == 0) {
+        n = set_detect_rules(0, 0);
+    } else if(strcmp(argv[1], "load") == 0 && argc == 3) {
+        if((n = load_file(argv[2])) < 0)
+            exit(1);
+        n = set_detect_rules(rules, n);
+    } else if(strcmp(argv[1], "add") == 0 && argc > 2) {
+        n = get_detect_rules(rules, MAX_RULES);
+        if(n < 0 || n == MAX_RULES) {
+            fprintf(2, "detectctl: rule table full\n");
+            exit(1);
+        }
+        rule_defaults(&rules[n]);
+        for(int i = 2; i < argc; i++) {
+            if(parse_word(&rules[n], argv[i]) < 0)
+                exit(1);
+        }
+        n = set_detect_rules(rules, n + 1);
+    } else if(strcmp(argv[1], "del") == 0 && argc == 3) {
+        int idx = atoi(argv[2]);
+        n = get_detect_rules(rules, MAX_RULES);
+        if(n < 0 || idx < 0 || idx >= n) {
+            fprintf(2, "detectctl: no rule %d\n", idx);
+            exit(1);
+        }
+        for(int i = idx; i < n - 1; i++)
+            rules[i] = rules[i + 1];
+        n = set_detect_rules(rules, n - 1);
+    } else {
+        usage();
+    }
+
+    if(n < 0) {
+        fprintf(2, "detectctl: kernel rejected the rules\n");
+        exit(1);
+    }
+    printf("%d detection rules loaded\n", n);
+    exit(0);
+}
@@ -23,6 +23,16 @@ main(void)
   dup(0);  // stdout
   dup(0);  // stderr
 
+  // audit log devices, see kernel/filelog.c
+  if(open("auditlog", O_RDONLY) < 0)
+    mknod("auditlog", AUDITLOG, AUDITLOG_FOLLOW);
+  else
+    close(3);
+  if(open("auditdump", O_RDONLY) < 0)
+    mknod("auditdump", AUDITLOG, AUDITLOG_DUMP);
+  else
+    close(3);
+
   for(;;){
     printf("init: starting sh\n");
     pid = fork();
@@ -165,8 +165,11 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
+    if(fork1() == 0){
+      // each command line is its own session for the detector
+      setsid();
       runcmd(parsecmd(buf));
+    }
     wait(0);
   }
   exit(0);
@@ -0,0 +1,148 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// showalerts: print alerts from the kernel alert queue as they arrive.
+
+static char *op_names[NOPS] = {
+    [OP_OPEN] "OPEN", [OP_READ] "READ", [OP_WRITE] "WRITE",
+    [OP_CLOSE] "CLOSE", [OP_CREATE] "CREATE", [OP_DELETE] "DELETE",
+    [OP_CHDIR] "CHDIR", [OP_EXEC] "EXEC", [OP_LINK] "LINK",
+    [OP_MKDIR] "MKDIR", [OP_MKNOD] "MKNOD", [OP_DUP] "DUP",
+    [OP_PIPE] "PIPE", [OP_FORK] "FORK",
+};
+
+static char *kind_names[NALERTKINDS] = {
+    [ALERT_RULE] "rule", [ALERT_RANSOM_REWRITE] "ransomware rewrite",
+    [ALERT_RANSOM_REPLACE] "ransomware replace", [ALERT_WATCHLIST] "watchlist",
+    [ALERT_CANARY] "canary", [ALERT_SEQ_READ] "sequential read",
+    [ALERT_ANOMALY] "anomaly", [ALERT_DISTINCT] "distinct files",
+    [ALERT_THROTTLE] "throttle",
+};
+
+static char *metric_names[BL_NMETRICS] = {
+    [BL_OPS] "ops/sec", [BL_FAIL] "failure ratio",
+    [BL_FILES] "files/sec", [BL_BYTES] "bytes/sec",
+};
+
+static char *console_modes[] = {
+    [ALERT_CONSOLE_OFF] "off",
+    [ALERT_CONSOLE_OVERFLOW] "overflow",
+    [ALERT_CONSOLE_ALL] "all",
+};
+
+#define NALERTS 8
+
+static struct detect_alert alerts[NALERTS];
+
+static void
+print_alert(struct detect_alert *a)
+{
+    char *op = (a->op > 0 && a->op < NOPS) ? op_names[a->op] : "?";
+
+    printf("[%d] tick %d: PID %d (%s) session %d ", a->seq, a->tick, a->pid,
+           a->proc_name, a->sid);
+    if(a->op < 0) {
+        // firings left over when the source went quiet
+        printf("%s", (a->kind > 0 && a->kind < NALERTKINDS) ? kind_names[a->kind] : "?");
+        if(a->rule >= 0) {
+            printf(" %d", a->rule);
+        }
+        printf(": fired %d more times over %d ticks\n", a->count, a->span);
+        return;
+    } else if(a->kind == ALERT_RANSOM_REWRITE) {
+        printf("ransomware pattern: %d files/sec read and rewritten, last %s\n",
+               a->rate, a->filename);
+    } else if(a->kind == ALERT_RANSOM_REPLACE) {
+        printf("ransomware pattern: %d files/sec replaced and deleted, last %s\n",
+               a->rate, a->filename);
+    } else if(a->kind == ALERT_THROTTLE) {
+        printf("rule %d: file syscalls throttled\n", a->rule);
+    } else if(a->kind == ALERT_DISTINCT) {
+        printf("rule %d: ~%d distinct files recently, last %s\n",
+               a->rule, a->rate, a->filename);
+    } else if(a->kind == ALERT_ANOMALY) {
+        printf("%s %d deviations above the %s baseline\n",
+               (a->rule >= 0 && a->rule < BL_NMETRICS) ? metric_names[a->rule] : "?",
+               a->rate, a->proc_name);
+    } else if(a->kind == ALERT_SEQ_READ) {
+        printf("read all %d bytes of %s sequentially (inode %d)\n",
+               a->rate, a->filename, a->inum);
+    } else if(a->kind == ALERT_CANARY) {
+        printf("parent %d: %s on canary %s (inode %d)\n",
+               a->ppid, op, a->filename, a->inum);
+    } else if(a->kind == ALERT_WATCHLIST) {
+        printf("%s %s on protected path %s\n", op,
+               a->status ? "OK" : "FAIL", a->filename);
+    } else {
+        printf("rule %d: %d %s %s/sec on %s\n", a->rule, a->rate,
+               op, a->status ? "OK" : "FAIL", a->filename);
+    }
+    if(a->count > 1) {
+        printf("    fired %d times over the last %d ticks\n", a->count, a->span);
+    }
+}
+
+static void
+usage(void)
+{
+    fprintf(2, "Usage: showalerts [-n count]\n");
+    fprintf(2, "       showalerts -s\n");
+    fprintf(2, "       showalerts -c off|overflow|all\n");
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int limit = -1;
+
+    if(argc == 2 && strcmp(argv[1], "-s") == 0) {
+        struct alert_stats st;
+        if(get_alert_stats(&st) < 0) {
+            fprintf(2, "showalerts: cannot read alert stats\n");
+            exit(1);
+        }
+        printf("Alerts raised: %d\n", st.raised);
+        printf("Alerts delivered: %d\n", st.delivered);
+        printf("Alerts dropped: %d\n", st.dropped);
+        printf("Canary alerts: %d\n", st.canaries);
+        printf("Alerts queued: %d\n", st.queued);
+        printf("Console fallback: %s\n", console_modes[st.console]);
+        exit(0);
+    }
+
+    if(argc == 3 && strcmp(argv[1], "-c") == 0) {
+        int mode;
+        for(mode = 0; mode <= ALERT_CONSOLE_ALL; mode++) {
+            if(strcmp(argv[2], console_modes[mode]) == 0)
+                break;
+        }
+        if(mode > ALERT_CONSOLE_ALL || set_alert_console(mode) < 0)
+            usage();
+        printf("Console fallback: %s\n", console_modes[mode]);
+        exit(0);
+    }
+
+    if(argc == 3 && strcmp(argv[1], "-n") == 0) {
+        limit = atoi(argv[2]);
+    } else if(argc != 1) {
+        usage();
+    }
+
+    while(limit != 0) {
+        int max = NALERTS;
+        if(limit > 0 && limit < max)
+            max = limit;
+        int n = wait_alerts(alerts, max);
+        if(n < 0) {
+            fprintf(2, "showalerts: wait_alerts failed\n");
+            exit(1);
+        }
+        for(int i = 0; i < n; i++)
+            print_alert(&alerts[i]);
+        if(limit > 0)
+            limit -= n;
+    }
+    exit(0);
+}
@@ -30,6 +30,15 @@ strncmp(const char *p, const char *q, uint n)
   return (uchar)*p - (uchar)*q;
 }
 
+// Status column; '*' marks watchlisted paths and audited inodes
+static char*
+status_str(struct file_access_log *log)
+{
+    if(log->watch || log->audit)
+        return log->status ? "OK*" : "FAIL*";
+    return log->status ? "OK" : "FAIL";
+}
+
 void pad(const char *s, int width) {
     int len = strlen(s);
     if(len > width) {
@@ -77,12 +86,24 @@ void pad_num(int num, int width) {
         printf(" ");
 }
 
+// Offset column; "-" for operations without a file offset
+static void
+pad_offset(int off, int width)
+{
+    if(off < 0)
+        pad("-", width);
+    else
+        pad_num(off, width);
+}
+
 struct filters {
     int pid;
+    int sid;
     char proc_name[16];
     char file_name[FILENAME_MAX];
     int status; // 0 = FAIL, 1 = OK, -1 = no filter
     int filter_by_pid;
+    int filter_by_sid;
     int filter_by_proc_name;
     int filter_by_file_name;
     int filter_by_status;
@@ -94,6 +115,7 @@ void print_help() {
     printf("  -c                Clear history logs\n");
     printf("  -s                Show history storage statistics\n");
     printf("  --pid <pid>       Filter by process ID\n");
+    printf("  --sid <sid>       Filter by session ID (a whole process tree)\n");
     printf("  -p <proc_name>    Filter by process name\n");
     printf("  -f <file_name>    Filter by file name\n");
     printf("  --status <OK|FAIL> Filter by operation status\n");
@@ -113,7 +135,10 @@ main(int argc, char *argv[])
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-c") == 0) {
-            clear_history_logs();
+            if(clear_history_logs() < 0) {
+                fprintf(2, "showhistory: cannot clear history\n");
+                exit(1);
+            }
             printf("History storage cleared.\n");
             exit(0);
         } else if (strcmp(argv[i], "-s") == 0) {
@@ -130,6 +155,9 @@ main(int argc, char *argv[])
         } else if (strcmp(argv[i], "--pid") == 0 && i + 1 < argc) {
             f.pid = atoi(argv[++i]);
             f.filter_by_pid = 1;
+        } else if (strcmp(argv[i], "--sid") == 0 && i + 1 < argc) {
+            f.sid = atoi(argv[++i]);
+            f.filter_by_sid = 1;
         } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
             safestrcpy_user(f.proc_name, argv[++i], sizeof(f.proc_name));
             f.filter_by_proc_name = 1;
@@ -188,10 +216,11 @@ main(int argc, char *argv[])
     }
     
     printf("History File Access Log (fetched %d entries, applying filters):\n", count);
-    printf("PID    Process    Operation    File             Bytes    Status    Time\n");
-    printf("---    -------    ---------    --------------   -----    ------    ----\n");
+    printf("PID    PPID   SID    Process    Operation    File             Bytes    Offset    Status    Time\n");
+    printf("---    ----   ---    -------    ---------    --------------   -----    ------    ------    ----\n");
     
     int displayed_count = 0;
+    char when[25];
     for(int i = 0; i < count; i++) {
         struct file_access_log *current_log = &logs[i];
         int match = 1;
@@ -199,6 +228,9 @@ main(int argc, char *argv[])
         if (f.filter_by_pid && current_log->pid != f.pid) {
             match = 0;
         }
+        if (match && f.filter_by_sid && current_log->sid != f.sid) {
+            match = 0;
+        }
         if (match && f.filter_by_proc_name && strncmp(current_log->proc_name, f.proc_name, sizeof(current_log->proc_name)) != 0) {
             match = 0;
         }
@@ -211,12 +243,23 @@ main(int argc, char *argv[])
 
         if (match) {
             pad_num(logs[i].pid, 3);        printf("    ");
+            pad_num(logs[i].ppid, 3);       printf("    ");
+            pad_num(logs[i].sid, 3);        printf("    ");
             pad(logs[i].proc_name, 7);     printf("    ");
             pad(logs[i].operation, 9);      printf("    ");
             pad(logs[i].filename, 14);      printf("    ");
             pad_num(logs[i].bytes_transferred, 5); printf("    ");
-            pad(logs[i].status ? "OK" : "FAIL", 6); printf("    ");
-            pad(logs[i].timestamp, 24); printf("\n");
+            pad_offset(logs[i].offset, 6); printf("    ");
+            pad(status_str(&logs[i]), 6); printf("    ");
+            fmttime(logs[i].time, when);
+            pad(when, 24); printf("\n");
+            if(logs[i].inum)
+                printf("       inode %d  image %lx  argv %lx\n",
+                       logs[i].inum, logs[i].hash, logs[i].argv_hash);
+            if(logs[i].repeat > 1) {
+                fmttime(logs[i].last_time, when);
+                printf("       repeated %d times, last at %s\n", logs[i].repeat, when);
+            }
             displayed_count++;
         }
     }
@@ -1,6 +1,16 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
+#include "kernel/fcntl.h"
+
+// Status column; '*' marks watchlisted paths and audited inodes
+static char*
+status_str(struct file_access_log *log)
+{
+    if(log->watch || log->audit)
+        return log->status ? "OK*" : "FAIL*";
+    return log->status ? "OK" : "FAIL";
+}
 
 void pad(const char *s, int width) {
     int len = strlen(s);
@@ -49,9 +59,188 @@ void pad_num(int num, int width) {
         printf(" ");
 }
 
+// Offset column; "-" for operations without a file offset
+static void
+pad_offset(int off, int width)
+{
+    if(off < 0)
+        pad("-", width);
+    else
+        pad_num(off, width);
+}
+
+static void
+print_header(void)
+{
+    printf("PID    PPID   SID    Process    Operation    File             Bytes    Offset    Status    Date\'Time                    \n");
+    printf("---    ----   ---    -------    ---------    --------------   -----    ------    ------    ------------------------\n");
+}
+
+static void
+print_log(struct file_access_log *log)
+{
+    char when[25];
+
+    pad_num(log->pid, 3);        printf("    ");
+    pad_num(log->ppid, 3);       printf("    ");
+    pad_num(log->sid, 3);        printf("    ");
+    pad(log->proc_name, 7);     printf("    ");
+    pad(log->operation, 9);      printf("    ");
+    pad(log->filename, 14);      printf("    ");
+    pad_num(log->bytes_transferred, 5); printf("   ");
+    pad_offset(log->offset, 6); printf("    ");
+    pad(status_str(log), 6); printf("    ");
+    fmttime(log->time, when);
+    pad(when, 24); printf("\n");
+    if(log->inum)
+        printf("       inode %d  image %lx  argv %lx\n", log->inum, log->hash, log->argv_hash);
+    if(log->repeat > 1) {
+        fmttime(log->last_time, when);
+        printf("       repeated %d times, last at %s\n", log->repeat, when);
+    }
+}
+
+// Print every record the audit log still holds, then each new
+// one as it is logged
+static void
+follow(void)
+{
+    struct file_access_log logs[20];
+    int fd = open("/auditlog", O_RDONLY);
+
+    if(fd < 0) {
+        printf("showlogs: cannot open /auditlog\n");
+        exit(1);
+    }
+    print_header();
+    for(;;) {
+        int n = read(fd, logs, sizeof(logs));
+        if(n <= 0)
+            break;
+        for(int i = 0; i < n / sizeof(logs[0]); i++)
+            print_log(&logs[i]);
+    }
+    close(fd);
+}
+
+// Dashboard: counters, history, top files and the newest records,
+// all from one snapshot() call
+static void
+dashboard(void)
+{
+    static struct file_access_log recent[5];
+    static struct snap_file files[8];
+    struct snap_counters c;
+    struct snap_history h;
+    struct snap_section secs[4] = {
+        { SNAP_COUNTERS, 1, (uint64)&c },
+        { SNAP_HISTORY, 1, (uint64)&h },
+        { SNAP_TOPFILES, 8, (uint64)files },
+        { SNAP_RECENT, 5, (uint64)recent },
+    };
+
+    if(snapshot(secs, 4) < 0) {
+        printf("Error taking a log snapshot\n");
+        exit(1);
+    }
+
+    printf("Snapshot at record %d\n", secs[0].seq);
+    printf("Records retained: %d (from %d), %d buffered, %d events logged since clear, %d folded as repeats\n",
+           c.retained, c.first_seq, c.buffered, c.total_accesses, c.folded);
+    printf("OPEN %d  READ %d  WRITE %d  CLOSE %d  CREATE %d  DELETE %d  CHDIR %d  failed %d\n",
+           c.ops[OP_OPEN], c.ops[OP_READ], c.ops[OP_WRITE], c.ops[OP_CLOSE],
+           c.ops[OP_CREATE], c.ops[OP_DELETE], c.ops[OP_CHDIR], c.failures);
+    printf("EXEC %d  LINK %d  MKDIR %d  MKNOD %d  DUP %d  PIPE %d  FORK %d\n",
+           c.ops[OP_EXEC], c.ops[OP_LINK], c.ops[OP_MKDIR], c.ops[OP_MKNOD],
+           c.ops[OP_DUP], c.ops[OP_PIPE], c.ops[OP_FORK]);
+    printf("Bytes read: %d, written: %d\n", c.bytes_read, c.bytes_written);
+    printf("History: %d records in %d chunks", h.total_logs, h.total_chunks);
+    if(h.total_chunks > 0)
+        printf(", records %d to %d, sealed ticks %d to %d", h.first_seq, h.last_seq,
+               h.oldest, h.newest);
+    printf(", %d chunks not exported\n", h.export_dropped);
+
+    printf("\nTop files:\n");
+    printf("Accesses  Reads  Writes  Failed  Bytes     File\n");
+    for(int i = 0; i < secs[2].count; i++) {
+        pad_num(files[i].accesses, 8); printf("  ");
+        pad_num(files[i].reads, 5); printf("  ");
+        pad_num(files[i].writes, 6); printf("  ");
+        pad_num(files[i].failures, 6); printf("  ");
+        pad_num(files[i].bytes, 8); printf("  ");
+        printf("%s\n", files[i].filename);
+    }
+
+    printf("\nRecent:\n");
+    print_header();
+    for(int i = 0; i < secs[3].count; i++)
+        print_log(&recent[i]);
+}
+
+static char *class_names[NLOGCLASS] = {
+    [LOG_BUFFER] "buffer", [LOG_HISTORY] "history",
+};
+
+static char *policy_names[] = {
+    [LOG_OVERWRITE] "overwrite", [LOG_DROP_NEW] "drop", [LOG_BLOCK] "block",
+};
+
+// Show the overflow policies and counters, or set one. showlogs
+// itself is never logged, so it still runs when producers block.
+static void
+policy(int argc, char *argv[])
+{
+    struct log_class_stats st[NLOGCLASS];
+
+    if(argc == 4) {
+        int class, p;
+        for(class = 0; class < NLOGCLASS; class++)
+            if(strcmp(argv[2], class_names[class]) == 0)
+                break;
+        for(p = LOG_OVERWRITE; p <= LOG_BLOCK; p++)
+            if(strcmp(argv[3], policy_names[p]) == 0)
+                break;
+        if(class == NLOGCLASS || p > LOG_BLOCK || set_log_policy(class, p) < 0) {
+            printf("Usage: showlogs -p [buffer|history overwrite|drop|block]\n");
+            exit(1);
+        }
+    } else if(argc != 2) {
+        printf("Usage: showlogs -p [buffer|history overwrite|drop|block]\n");
+        exit(1);
+    }
+
+    if(get_log_policy(st) < 0) {
+        printf("Error retrieving log policies\n");
+        exit(1);
+    }
+    printf("Class     Policy     Overwritten  Dropped  Blocked\n");
+    for(int i = 0; i < NLOGCLASS; i++) {
+        pad(class_names[i], 8); printf("  ");
+        pad(policy_names[st[i].policy], 9); printf("  ");
+        pad_num(st[i].overwritten, 11); printf("  ");
+        pad_num(st[i].dropped, 7); printf("  ");
+        pad_num(st[i].blocked, 7); printf("\n");
+    }
+}
+
 int
 main(int argc, char *argv[])
 {
+    if(argc > 1 && strcmp(argv[1], "-f") == 0) {
+        follow();
+        exit(0);
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-d") == 0) {
+        dashboard();
+        exit(0);
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-p") == 0) {
+        policy(argc, argv);
+        exit(0);
+    }
+
     if(argc > 1 && strcmp(argv[1], "-c") == 0) {
         // Clear logs
         clear_logs();
@@ -89,18 +278,9 @@ main(int argc, char *argv[])
     }
     
     printf("Recent File Access Log (%d entries):\n", count);
-    printf("PID    Process    Operation    File             Bytes    Status    Date\'Time                    \n");
-    printf("---    -------    ---------    --------------   -----    ------    ------------------------\n");
-    
-    for(int i = 0; i < count; i++) {
-        pad_num(logs[i].pid, 3);        printf("    ");
-        pad(logs[i].proc_name, 7);     printf("    ");
-        pad(logs[i].operation, 9);      printf("    ");
-        pad(logs[i].filename, 14);      printf("    ");
-        pad_num(logs[i].bytes_transferred, 5); printf("   ");
-        pad(logs[i].status ? "OK" : "FAIL", 6); printf("    ");
-        pad(logs[i].timestamp, 24); printf("\n");
-    }
+    print_header();
+    for(int i = 0; i < count; i++)
+        print_log(&logs[i]);
     
     exit(0);
 }
\ No newline at end of file
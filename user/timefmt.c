@@ -0,0 +1,75 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Formatting of the raw times (seconds since 1970-01-01) stored in
+// log records. A listing is mostly one day's records, so the date
+// part is cached and only recomputed when a record falls on another
+// day; the rest is a few divisions.
+
+static char *month_names[] = {"", "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                              "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static char *day_names[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+
+static struct {
+    uint day;       // days since 1970-01-01 of date[], ~0 if none
+    char date[11];  // "Www Mmm dd"
+    char year[5];
+} cache = { 0xffffffff };
+
+// Civil date of a day count since 1970-01-01, in constant time
+// (Howard Hinnant's civil_from_days)
+static void
+civil_from_days(uint days, int *year, int *month, int *day)
+{
+    uint z = days + 719468;
+    uint era = z / 146097;
+    uint doe = z - era * 146097;                                  // [0, 146096]
+    uint yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;   // [0, 399]
+    uint doy = doe - (365*yoe + yoe/4 - yoe/100);                 // [0, 365]
+    uint mp = (5*doy + 2) / 153;                                  // [0, 11]
+
+    *day = doy - (153*mp + 2)/5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = era * 400 + yoe + (*month <= 2);
+}
+
+static void
+two_digits(char *p, int v, char lead)
+{
+    p[0] = v < 10 ? lead : '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+// Format t as "Www Mmm dd hh:mm:ss yyyy" into buf, which must
+// hold 25 bytes
+void
+fmttime(uint t, char *buf)
+{
+    uint days = t / 86400;
+    uint secs = t % 86400;
+
+    if(days != cache.day) {
+        int year, month, day;
+        civil_from_days(days, &year, &month, &day);
+        memmove(cache.date, day_names[(days + 4) % 7], 3);   // 1970-01-01 was a Thursday
+        cache.date[3] = ' ';
+        memmove(cache.date + 4, month_names[month], 3);
+        cache.date[7] = ' ';
+        two_digits(cache.date + 8, day, ' ');
+        for(int i = 3; i >= 0; i--, year /= 10)
+            cache.year[i] = '0' + year % 10;
+        cache.day = days;
+    }
+
+    memmove(buf, cache.date, 10);
+    buf[10] = ' ';
+    two_digits(buf + 11, secs / 3600, '0');
+    buf[13] = ':';
+    two_digits(buf + 14, secs / 60 % 60, '0');
+    buf[16] = ':';
+    two_digits(buf + 17, secs % 60, '0');
+    buf[19] = ' ';
+    memmove(buf + 20, cache.year, 4);
+    buf[24] = 0;
+}
@@ -1,4 +1,7 @@
 #include "kernel/filelog.h"
+#include "kernel/detect.h"
+#include "kernel/time.h"
+#include "kernel/siphash.h"
 
 struct stat;
 
@@ -30,6 +33,29 @@ int clear_logs(void);
 int get_history_logs(struct file_access_log *logs, int max_entries, int offset);
 int get_history_stats(int *total_logs, int *total_chunks);
 int clear_history_logs(void);
+int set_detect_rules(struct detect_rule *rules, int n);
+int get_detect_rules(struct detect_rule *rules, int max);
+int wait_alerts(struct detect_alert *alerts, int max);
+int get_alert_stats(struct alert_stats *stats);
+int set_alert_console(int mode);
+int set_watchlist(struct watchlist_entry *entries, int n);
+int get_watchlist(struct watchlist_entry *entries, int max);
+int set_audit(const char *path, int flags);
+int set_baselines(struct prog_baseline *baselines, int n);
+int get_baselines(struct prog_baseline *baselines, int max);
+int get_file_cardinality(int pid, struct file_cardinality *card);
+int setsid(void);
+int get_session_stats(int sid, struct session_stats *stats);
+uint time(void);
+int clock_gettime(struct timespec *ts);
+int snapshot(struct snap_section *secs, int n);
+uint64 syscall_audit(uint64 enable, uint64 disable);
+int fim(const char *path, int op, uint64 *root);
+int set_log_key(uint64 key[2]);
+int get_history_chunk(uint index, struct chunk_meta *meta, struct file_access_log *logs);
+int watch(const char *path, int mask);
+int set_log_policy(int class, int policy);
+int get_log_policy(struct log_class_stats *stats);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -49,3 +75,6 @@ void *memcpy(void *, const void *, uint);
 // umalloc.c
 void* malloc(uint);
 void free(void*);
+
+// timefmt.c
+void fmttime(uint, char*);
@@ -41,4 +41,27 @@ entry("get_file_stats");
 entry("clear_logs");
 entry("get_history_logs");
 entry("get_history_stats");
-entry("clear_history_logs");
\ No newline at end of file
+entry("clear_history_logs");
+entry("set_detect_rules");
+entry("get_detect_rules");
+entry("wait_alerts");
+entry("get_alert_stats");
+entry("set_alert_console");
+entry("set_watchlist");
+entry("get_watchlist");
+entry("set_audit");
+entry("set_baselines");
+entry("get_baselines");
+entry("get_file_cardinality");
+entry("setsid");
+entry("get_session_stats");
+entry("time");
+entry("clock_gettime");
+entry("snapshot");
+entry("syscall_audit");
+entry("fim");
+entry("set_log_key");
+entry("get_history_chunk");
+entry("watch");
+entry("set_log_policy");
+entry("get_log_policy");
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// verifylog: walk the chain of sealed history chunks and check that
+// no record was altered, no chunk removed from the middle and no
+// chunk reordered. Chunks sealed before the key was set use a zero
+// key and only show accidental damage; the rest can only be forged
+// with the key.
+//
+//   verifylog [key]      verify, key as 32 hex digits
+//   verifylog -s key     set the kernel's key (once per boot)
+
+static struct file_access_log logs[MAX_LOG_ENTRIES];
+
+static void
+usage(void)
+{
+    fprintf(2, "Usage: verifylog [key]\n");
+    fprintf(2, "       verifylog -s key\n");
+    fprintf(2, "key is 32 hex digits\n");
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    uint64 key[2], zero[2] = { 0, 0 };
+    int havekey = 0;
+
+    if(argc == 3 && strcmp(argv[1], "-s") == 0) {
+        if(!parsekey(argv[2], key))
+            usage();
+        if(set_log_key(key) < 0) {
+            fprintf(2, "verifylog: key already set\n");
+            exit(1);
+        }
+        printf("Log key set.\n");
+        exit(0);
+    }
+    if(argc == 2) {
+        if(!parsekey(argv[1], key))
+            usage();
+        havekey = 1;
+    } else if(argc != 1) {
+        usage();
+    }
+
+    struct chunk_meta meta;
+    uint next = 0;
+    uint64 prev = 0;
+    int chunks = 0, records = 0, bad = 0, unkeyed = 0, skipped = 0;
+
+    while(get_history_chunk(next, &meta, logs) == 0) {
+        struct chunk_link *l = &meta.link;
+
+        if(l->index != next) {
+            if(chunks == 0)
+                printf("chunks 0 to %d evicted or cleared\n", l->index - 1);
+            else
+                printf("chunks %d to %d missing\n", next, l->index - 1);
+        }
+
+        uint64 *k = meta.keyed ? key : zero;
+        if(meta.keyed && !havekey) {
+            skipped++;
+        } else {
+            if(siphash(k[0], k[1], logs, l->count * sizeof(logs[0])) != l->body) {
+                printf("chunk %d: records altered\n", l->index);
+                bad++;
+            } else if(siphash(k[0], k[1], l, sizeof(*l)) != meta.mac) {
+                printf("chunk %d: seal altered\n", l->index);
+                bad++;
+            }
+            if(!meta.keyed)
+                unkeyed++;
+        }
+        // the previous chunk is known only if we just saw it
+        if((l->index == 0 && l->prev != 0) ||
+           (chunks > 0 && l->index == next && l->prev != prev)) {
+            printf("chunk %d: chain broken\n", l->index);
+            bad++;
+        }
+
+        for(int i = 0; i < l->count; i++) {
+            if(strcmp(logs[i].operation, "CLEAR") == 0) {
+                printf("chunk %d: PID %d (%s) cleared %d records of the %s\n",
+                       l->index, logs[i].pid, logs[i].proc_name,
+                       logs[i].bytes_transferred, logs[i].filename);
+            }
+        }
+
+        chunks++;
+        records += l->count;
+        prev = meta.mac;
+        next = l->index + 1;
+    }
+
+    printf("%d chunks, %d records: %d bad", chunks, records, bad);
+    if(unkeyed)
+        printf(", %d sealed before the key was set", unkeyed);
+    if(skipped)
+        printf(", %d keyed but not checked without the key", skipped);
+    printf("\n");
+    exit(bad ? 1 : 0);
+}
@@ -0,0 +1,91 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// watchfile: print open, write and delete events on a file as
+// they happen, without polling the access log.
+
+static char *event_names[] = {
+    [IW_OPEN] "open", [IW_WRITE] "write", [IW_DELETE] "delete",
+    [IW_OVERFLOW] "overflow",
+};
+
+#define NEVENTS 8
+
+static struct iwatch_event events[NEVENTS];
+
+static void
+usage(void)
+{
+    fprintf(2, "Usage: watchfile [-n count] <path> [open,write,delete]\n");
+    exit(1);
+}
+
+// Parse a comma separated list of event names into a mask
+static int
+parse_mask(char *s)
+{
+    int mask = 0;
+
+    while(*s) {
+        char *e = s;
+        while(*e && *e != ',')
+            e++;
+        int found = 0;
+        for(int bit = IW_OPEN; bit <= IW_DELETE; bit <<= 1) {
+            if(strlen(event_names[bit]) == e - s &&
+               memcmp(s, event_names[bit], e - s) == 0) {
+                mask |= bit;
+                found = 1;
+            }
+        }
+        if(!found)
+            return 0;
+        s = *e ? e + 1 : e;
+    }
+    return mask;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int limit = -1;
+    int mask = IW_ALL;
+
+    if(argc >= 3 && strcmp(argv[1], "-n") == 0) {
+        limit = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    if(argc < 2 || argc > 3)
+        usage();
+    if(argc == 3 && (mask = parse_mask(argv[2])) == 0)
+        usage();
+
+    int fd = watch(argv[1], mask);
+    if(fd < 0) {
+        fprintf(2, "watchfile: cannot watch %s\n", argv[1]);
+        exit(1);
+    }
+
+    while(limit != 0) {
+        int n = read(fd, events, sizeof(events));
+        if(n < 0) {
+            fprintf(2, "watchfile: read failed\n");
+            exit(1);
+        }
+        for(int i = 0; i < n / sizeof(events[0]) && limit != 0; i++) {
+            struct iwatch_event *e = &events[i];
+            if(e->mask == IW_OVERFLOW) {
+                printf("tick %d: %d events dropped\n", e->tick, e->count);
+                continue;
+            }
+            printf("tick %d: %s %s by PID %d (%s)\n", e->tick,
+                   event_names[e->mask], argv[1], e->pid, e->proc_name);
+            if(limit > 0)
+                limit--;
+        }
+    }
+    close(fd);
+    exit(0);
+}